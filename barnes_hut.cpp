@@ -0,0 +1,207 @@
+#include "barnes_hut.h"
+#include <algorithm>
+#include <cmath>
+
+
+void Quadtree::build(const Body_Store &bodies) {
+
+    // reuse the storage from the previous step so rebuilding doesn't allocate
+    nodes.clear();
+    next.assign(bodies.size(), -1);
+
+    if(bodies.empty()) { return; }
+
+    // find the bounding square of all the bodies
+    double minx = bodies.x[0], maxx = minx;
+    double miny = bodies.y[0], maxy = miny;
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        minx = std::min(minx, bodies.x[i]);
+        maxx = std::max(maxx, bodies.x[i]);
+        miny = std::min(miny, bodies.y[i]);
+        maxy = std::max(maxy, bodies.y[i]);
+    }
+
+    double half = std::max(maxx - minx, maxy - miny) / 2 * 1.0001 + 1e-9;
+    nodes.push_back( Node{ (minx + maxx)/2, (miny + maxy)/2, half, 0, 0, 0, -1, -1, 0 } );
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        insert(i, bodies);
+    }
+
+    // children are always created after their parents, so walking the nodes backwards
+    // accumulates mass and centre of mass from the leaves up to the root
+    for(int n = nodes.size()-1; n >= 0; n--) {
+
+        Node &node = nodes[n];
+
+        if(node.child == -1) {
+
+            for(int i = node.body; i != -1; i = next[i]) {
+
+                node.mass += bodies.m[i];
+                node.comx += bodies.m[i] * bodies.x[i];
+                node.comy += bodies.m[i] * bodies.y[i];
+            }
+        }
+        else {
+
+            for(int c = node.child; c < node.child+4; c++) {
+
+                node.mass += nodes[c].mass;
+                node.comx += nodes[c].comx;
+                node.comy += nodes[c].comy;
+            }
+        }
+    }
+
+    // comx and comy hold mass weighted sums until every parent has read them
+    for(Node &node : nodes) {
+
+        if(node.mass > 0) {
+
+            node.comx /= node.mass;
+            node.comy /= node.mass;
+        }
+    }
+}
+
+int Quadtree::quadrant(const Node &node, double x, double y) const {
+
+    // quadrants are numbered 0-3 with bit 0 set for the right half and bit 1 for the bottom half
+    return (x >= node.cx) + 2*(y >= node.cy);
+}
+
+void Quadtree::split(int n) {
+
+    // add 4 children to node n, invalidating any references into nodes
+    Node parent  = nodes[n];
+    double h     = parent.half / 2;
+    nodes[n].child = nodes.size();
+
+    for(int q = 0; q < 4; q++) {
+
+        double cx = parent.cx + ((q & 1) ? h : -h);
+        double cy = parent.cy + ((q & 2) ? h : -h);
+        nodes.push_back( Node{ cx, cy, h, 0, 0, 0, -1, -1, parent.depth+1 } );
+    }
+}
+
+void Quadtree::insert(int i, const Body_Store &bodies) {
+
+    int n = 0;
+
+    while(true) {
+
+        // descend through internal nodes
+        if(nodes[n].child != -1) {
+
+            n = nodes[n].child + quadrant(nodes[n], bodies.x[i], bodies.y[i]);
+            continue;
+        }
+
+        // empty leaf or a leaf which can't be split any further - chain the body into it
+        if(nodes[n].body == -1 || nodes[n].depth >= max_depth) {
+
+            next[i]       = nodes[n].body;
+            nodes[n].body = i;
+            return;
+        }
+
+        // occupied leaf - split it and push its bodies down a level, then retry from this node
+        int chain     = nodes[n].body;
+        nodes[n].body = -1;
+        split(n);
+
+        while(chain != -1) {
+
+            int following = next[chain];
+            int c         = nodes[n].child + quadrant(nodes[n], bodies.x[chain], bodies.y[chain]);
+            next[chain]   = nodes[c].body;
+            nodes[c].body = chain;
+            chain         = following;
+        }
+    }
+}
+
+std::array<double, 2> Quadtree::acceleration(int i, const Body_Store &bodies, double theta, double cutoff,
+                                             long *interactions) const {
+
+    std::array<double, 2> acc = {0, 0};
+    long                  summed = 0;
+
+    if(nodes.empty()) { return acc; }
+
+    double x = bodies.x[i];
+    double y = bodies.y[i];
+
+    // each level of the tree pushes at most 4 nodes so the stack depth is bounded
+    int stack[4*max_depth + 8];
+    int top  = 0;
+    stack[top++] = 0;
+
+    while(top > 0) {
+
+        const Node &node = nodes[stack[--top]];
+
+        if(node.mass == 0) { continue; }
+
+        // distances from the body to the nearest and furthest points of the node's square
+        double ex = std::max(std::abs(x - node.cx) - node.half, 0.0);
+        double ey = std::max(std::abs(y - node.cy) - node.half, 0.0);
+        double fx = std::abs(x - node.cx) + node.half;
+        double fy = std::abs(y - node.cy) + node.half;
+
+        // every body in the node is beyond the cutoff so none of them contribute
+        if(ex*ex + ey*ey > cutoff*cutoff) { continue; }
+
+        if(node.child == -1) {
+
+            // leaf - sum the bodies directly, exactly as the direct sum does
+            for(int j = node.body; j != -1; j = next[j]) {
+
+                if(j == i) { continue; }
+
+                double dx = bodies.x[j] - x;
+                double dy = bodies.y[j] - y;
+                double d  = sqrt( dx*dx + dy*dy );
+
+                // a body at the same position has no direction to pull in, as the direct sum's mask has it
+                if(!(d > 0) || d > cutoff) { continue; }
+
+                acc[0] += 100 * bodies.m[j] * dx / (d*d*d);
+                acc[1] += 100 * bodies.m[j] * dy / (d*d*d);
+                summed++;
+            }
+
+            continue;
+        }
+
+        double dx = node.comx - x;
+        double dy = node.comy - y;
+        double d  = sqrt( dx*dx + dy*dy );
+
+        // treat the node as a point mass if it is far enough away, doesn't contain the body and lies
+        // entirely inside the cutoff, otherwise open it so that the cutoff is still applied body by body
+        bool outside = ex > 0 || ey > 0;
+
+        if(outside && 2*node.half < theta*d && fx*fx + fy*fy <= cutoff*cutoff) {
+
+            acc[0] += 100 * node.mass * dx / (d*d*d);
+            acc[1] += 100 * node.mass * dy / (d*d*d);
+            summed++;
+            continue;
+        }
+
+        for(int c = node.child; c < node.child+4; c++) {
+
+            stack[top++] = c;
+        }
+    }
+
+    if(interactions) { *interactions += summed; }
+
+    return acc;
+}
@@ -0,0 +1,43 @@
+#ifndef BARNES_HUT_H
+#define BARNES_HUT_H
+
+#include "body.h"
+#include <vector>
+#include <array>
+
+
+class Quadtree {
+
+public:
+    // rebuilds the tree around the current positions of bodies
+    void build(const Body_Store &bodies);
+
+    // acceleration on bodies[i] from every other body, opening nodes whose size/distance exceeds theta
+    // and ignoring any body further away than cutoff - adds the number of bodies and nodes summed to
+    // interactions if it is given
+    std::array<double, 2> acceleration(int i, const Body_Store &bodies, double theta, double cutoff,
+                                       long *interactions = nullptr) const;
+
+protected:
+    struct Node {
+
+        double cx, cy;      // centre of the node's square
+        double half;        // half of the side length of the square
+        double mass;        // total mass inside the node
+        double comx, comy;  // centre of mass of the node
+        int    child;       // index of the first of 4 consecutive children, -1 for a leaf
+        int    body;        // first body in a leaf, -1 if empty - further bodies are chained through next
+        int    depth;       // depth of the node below the root
+    };
+
+    void insert(int i, const Body_Store &bodies);
+    int  quadrant(const Node &node, double x, double y) const;
+    void split(int n);
+
+    static const int max_depth = 48; // bodies closer than the root size / 2^48 share a leaf
+
+    std::vector<Node>  nodes;          // nodes of the tree, nodes[0] is the root
+    std::vector<int>   next;           // next body in the same leaf, -1 at the end of the chain
+};
+
+#endif /* BARNES_HUT_H */
@@ -0,0 +1,73 @@
+#include "benchmark.h"
+#include "forces.h"
+#include "particle_mesh.h"
+#include "scenarios.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <cmath>
+
+
+// time taken per call of step in milliseconds, running it until at least half a second has passed
+template<class F>
+static double time_per_call(F step) {
+
+    step(); // warm up caches and wake the workers
+
+    auto start = std::chrono::steady_clock::now();
+    int  calls = 0;
+    double elapsed;
+
+    do {
+        step();
+        calls++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while(elapsed < 0.5);
+
+    return elapsed * 1000 / calls;
+}
+
+void scaling_benchmark(int n, int max_threads, std::ostream &out) {
+
+    if(max_threads <= 0) { max_threads = std::max(1u, std::thread::hardware_concurrency()); }
+
+    Body_Store bodies = make_scenario("disk", n, 1);
+
+    Direct_Sum direct;
+
+    Thread_Pool         pool(1);
+    Quadtree            tree;
+    Particle_Mesh       mesh;
+    std::vector<double> ax, ay;
+    std::vector<double> direct_x, tree_x, mesh_x; // single threaded results to compare against
+    double              direct_base = 0, tree_base = 0, mesh_base = 0;
+
+    out << "scaling benchmark: " << n << " bodies, " << direct.name << " kernel\n";
+    out << "threads   direct ms  speedup  identical     tree ms  speedup  identical      p3m ms  speedup  identical\n";
+
+    for(int threads = 1; ; threads = std::min(threads*2, max_threads)) {
+
+        pool.resize(threads);
+
+        double direct_ms = time_per_call( [&](){direct_accelerations(bodies, direct, 2000, 0, pool, ax, ay);} );
+        if(threads == 1) { direct_x = ax; direct_base = direct_ms; }
+        bool direct_same = std::memcmp(ax.data(), direct_x.data(), n * sizeof(double)) == 0;
+
+        double tree_ms   = time_per_call( [&](){tree_accelerations(bodies, tree, 0.5, 2000, pool, ax, ay);} );
+        if(threads == 1) { tree_x = ax; tree_base = tree_ms; }
+        bool tree_same   = std::memcmp(ax.data(), tree_x.data(), n * sizeof(double)) == 0;
+
+        double mesh_ms   = time_per_call( [&](){mesh_accelerations(bodies, mesh, 256, true, 2000, pool, ax, ay);} );
+        if(threads == 1) { mesh_x = ax; mesh_base = mesh_ms; }
+        bool mesh_same   = std::memcmp(ax.data(), mesh_x.data(), n * sizeof(double)) == 0;
+
+        out << std::fixed << std::setprecision(2)
+            << std::setw(7)  << threads
+            << std::setw(12) << direct_ms << std::setw(9) << direct_base/direct_ms << std::setw(11) << (direct_same ? "yes" : "NO")
+            << std::setw(12) << tree_ms   << std::setw(9) << tree_base/tree_ms     << std::setw(11) << (tree_same   ? "yes" : "NO")
+            << std::setw(12) << mesh_ms   << std::setw(9) << mesh_base/mesh_ms     << std::setw(11) << (mesh_same   ? "yes" : "NO")
+            << "\n";
+
+        if(threads == max_threads) { break; }
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <ostream>
+
+
+// times direct, tree and p3m force evaluation of a seeded random disc of bodies with 1, 2, 4 ... max_threads threads
+// and reports the speedup over one thread and whether the results were bit-identical
+void scaling_benchmark(int bodies, int max_threads, std::ostream &out);
+
+#endif /* BENCHMARK_H */
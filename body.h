@@ -0,0 +1,205 @@
+#ifndef BODY_H
+#define BODY_H
+
+#include "trail_arena.h"
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+
+
+struct Body {
+
+    std::array<double, 2> pos;
+    std::array<double, 2> vel;
+    double mass;
+};
+
+// refers to a body for as long as it exists, while its index changes as other bodies are removed -
+// the slot's generation moves on when the body is removed, so an old handle never finds a new body
+struct Body_Handle {
+
+    uint32_t slot;
+    uint32_t generation;
+
+    bool operator==(const Body_Handle &other) const { return slot == other.slot && generation == other.generation; }
+    bool operator!=(const Body_Handle &other) const { return !(*this == other); }
+};
+
+// stores bodies as a structure of arrays so that the force loops stream through
+// contiguous positions and masses, with the trails kept in separate storage. The arrays stay
+// dense - a removed body is replaced by the last one, so adding and removing a body costs the
+// same however many there are, and the slot table maps handles to the bodies' current indices
+struct Body_Store {
+
+    std::vector<double> x;  // x coordinate of each body
+    std::vector<double> y;  // y coordinate of each body
+    std::vector<double> vx; // x velocity of each body
+    std::vector<double> vy; // y velocity of each body
+    std::vector<double> m;  // mass of each body
+
+    std::vector<int>    level;  // timestep level of each body - its steps are 2^-level of the block
+    std::vector<double> ax;     // x acceleration of each body when its forces were last found
+    std::vector<double> ay;     // y acceleration of each body when its forces were last found
+
+    std::vector<int>    trail;  // ring of trails holding the points behind each body
+    Trail_Arena         trails; // storage for every trail
+
+    std::vector<Body_Handle> handle;           // handle of each body
+    std::vector<int>         slot_body;        // body holding each slot, -1 for a free slot
+    std::vector<uint32_t>    slot_generation;  // number of times each slot has been freed
+    std::vector<uint32_t>    free_slots;       // slots free for new bodies, most recently freed last
+
+    int  size() const { return m.size(); }
+    bool empty() const { return m.empty(); }
+
+    Body get(int i) const { return Body{ {x[i], y[i]}, {vx[i], vy[i]}, m[i] }; }
+
+    // adds a body at the end, taking a free slot for its handle - returns the handle
+    Body_Handle push_back(const Body &body) {
+
+        x.push_back(body.pos[0]);
+        y.push_back(body.pos[1]);
+        vx.push_back(body.vel[0]);
+        vy.push_back(body.vel[1]);
+        m.push_back(body.mass);
+        level.push_back(0);
+        ax.push_back(0);
+        ay.push_back(0);
+        trail.push_back(trails.acquire());
+        handle.push_back(new_handle(size() - 1));
+
+        return handle.back();
+    }
+
+    // gives body i a slot, reusing the most recently freed one
+    Body_Handle new_handle(int i) {
+
+        if(free_slots.empty()) {
+
+            free_slots.push_back(slot_body.size());
+            slot_body.push_back(-1);
+            slot_generation.push_back(0);
+        }
+
+        uint32_t slot = free_slots.back();
+        free_slots.pop_back();
+        slot_body[slot] = i;
+
+        return Body_Handle{ slot, slot_generation[slot] };
+    }
+
+    // index of the body with handle h, or -1 if it has been removed
+    int find(Body_Handle h) const {
+
+        if(h.slot >= slot_body.size() || slot_generation[h.slot] != h.generation) { return -1; }
+        return slot_body[h.slot];
+    }
+
+    // removes body i by moving the last body into its place
+    void swap_remove(int i) {
+
+        int last = size() - 1;
+
+        free_slot(handle[i].slot);
+        trails.release(trail[i]);
+
+        if(i != last) {
+
+            x[i]      = x[last];
+            y[i]      = y[last];
+            vx[i]     = vx[last];
+            vy[i]     = vy[last];
+            m[i]      = m[last];
+            level[i]  = level[last];
+            ax[i]     = ax[last];
+            ay[i]     = ay[last];
+            trail[i]  = trail[last];
+            handle[i] = handle[last];
+
+            slot_body[handle[i].slot] = i;
+        }
+
+        x.pop_back();
+        y.pop_back();
+        vx.pop_back();
+        vy.pop_back();
+        m.pop_back();
+        level.pop_back();
+        ax.pop_back();
+        ay.pop_back();
+        trail.pop_back();
+        handle.pop_back();
+    }
+
+    // reorders the bodies so that body k is the one which was at order[k], a permutation of the
+    // indices - each keeps its handle and trail
+    void permute(const std::vector<int> &order) {
+
+        gather(x, order);
+        gather(y, order);
+        gather(vx, order);
+        gather(vy, order);
+        gather(m, order);
+        gather(level, order);
+        gather(ax, order);
+        gather(ay, order);
+        gather(trail, order);
+        gather(handle, order);
+
+        for(int i = 0; i < size(); i++) { slot_body[handle[i].slot] = i; }
+    }
+
+    // removes the bodies with the given indices, highest first so that no body still to be removed
+    // is moved - sorts indices
+    void remove(std::vector<int> &indices) {
+
+        std::sort(indices.begin(), indices.end(), std::greater<int>());
+        indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+        for(int i : indices) { swap_remove(i); }
+    }
+
+    void clear() {
+
+        for(const Body_Handle &h : handle) { free_slot(h.slot); }
+
+        x.clear();
+        y.clear();
+        vx.clear();
+        vy.clear();
+        m.clear();
+        level.clear();
+        ax.clear();
+        ay.clear();
+        trail.clear();
+        handle.clear();
+        trails.clear();
+    }
+
+    Body_Store &operator=(std::initializer_list<Body> bodies) {
+
+        clear();
+        for(const Body &body : bodies) { push_back(body); }
+        return *this;
+    }
+
+    template<class T>
+    static void gather(std::vector<T> &values, const std::vector<int> &order) {
+
+        std::vector<T> moved(order.size());
+        for(size_t k = 0; k < order.size(); k++) { moved[k] = values[order[k]]; }
+        values.swap(moved);
+    }
+
+    // moves the slot's generation on, so that handles to the body which had it no longer find anything
+    void free_slot(uint32_t slot) {
+
+        slot_body[slot] = -1;
+        slot_generation[slot]++;
+        free_slots.push_back(slot);
+    }
+};
+
+#endif /* BODY_H */
@@ -0,0 +1,191 @@
+#include "collisions.h"
+#include "forces.h"
+#include <algorithm>
+#include <cmath>
+
+
+uint32_t Collision_Finder::hash(int64_t cx, int64_t cy) const {
+
+    return (uint32_t) ((cx * 73856093) ^ (cy * 19349663)) & mask;
+}
+
+void Collision_Finder::find(const Body_Store &bodies, Thread_Pool &pool, std::vector<std::array<int, 2>> &pairs) {
+
+    pairs.clear();
+    if(build(bodies)) { search(bodies, nullptr, pool, pairs); }
+}
+
+void Collision_Finder::find(const Body_Store &bodies, const std::vector<int> &active, Thread_Pool &pool,
+                            std::vector<std::array<int, 2>> &pairs) {
+
+    pairs.clear();
+    if(active.empty() || !build(bodies)) { return; }
+
+    searched.assign(bodies.size(), false);
+    for(int i : active) { searched[i] = true; }
+
+    search(bodies, &active, pool, pairs);
+
+    // pairs found from either end are stored lowest index first, so restore the order of the full search
+    std::sort(pairs.begin(), pairs.end());
+}
+
+bool Collision_Finder::build(const Body_Store &bodies) {
+
+    int n = bodies.size();
+
+    if(n < 2) { return false; }
+
+    // two bodies can only touch if they are closer than the sum of their radii, which is at most
+    // twice the largest radius of 10*mass, so colliding bodies are always in neighbouring cells
+    cell = 20 * *std::max_element(bodies.m.begin(), bodies.m.end());
+
+    if(!(cell > 0)) { return false; }
+
+    // at least twice as many buckets as bodies keeps unrelated cells from sharing buckets
+    uint32_t buckets = 1;
+    while(buckets < 2*(uint32_t)n) { buckets *= 2; }
+    mask = buckets - 1;
+
+    // counting sort the bodies by bucket
+    bucket.resize(n);
+    start.assign(buckets + 1, 0);
+    order.resize(n);
+
+    for(int i = 0; i < n; i++) {
+
+        bucket[i] = hash( (int64_t) std::floor(bodies.x[i]/cell), (int64_t) std::floor(bodies.y[i]/cell) );
+        start[bucket[i] + 1]++;
+    }
+
+    for(uint32_t b = 0; b < buckets; b++) { start[b+1] += start[b]; }
+
+    // fill each bucket in increasing body order, using the starts of the following buckets as cursors
+    for(int i = 0; i < n; i++) { order[start[bucket[i]]++] = i; }
+    for(uint32_t b = buckets; b > 0; b--) { start[b] = start[b-1]; }
+    start[0] = 0;
+
+    return true;
+}
+
+void Collision_Finder::search(const Body_Store &bodies, const std::vector<int> *active, Thread_Pool &pool,
+                              std::vector<std::array<int, 2>> &pairs) {
+
+    int n    = bodies.size();
+    int rows = active ? active->size() : n;
+
+    // each tile of bodies collects its own pairs, which are joined in tile order afterwards
+    int tiles = (rows + force_tile - 1) / force_tile;
+    tile_pairs.resize(tiles);
+
+    pool.run(tiles, [&](int t, int) {
+
+        std::vector<std::array<int, 2>> &found = tile_pairs[t];
+        found.clear();
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, rows);
+
+        for(int r = begin; r < end; r++) {
+
+            int      i1 = active ? (*active)[r] : r;
+            int64_t  cx = std::floor(bodies.x[i1]/cell);
+            int64_t  cy = std::floor(bodies.y[i1]/cell);
+            uint32_t seen[9];
+            int      visited = 0;
+
+            for(int ox = -1; ox <= 1; ox++) {
+                for(int oy = -1; oy <= 1; oy++) {
+
+                    // neighbouring cells can share a bucket - only search each bucket once
+                    uint32_t b = hash(cx + ox, cy + oy);
+                    if(std::find(seen, seen + visited, b) != seen + visited) { continue; }
+                    seen[visited++] = b;
+
+                    for(int k = start[b]; k < start[b+1]; k++) {
+
+                        // a pair of searched bodies is only found from its lower index
+                        int i2 = order[k];
+                        if(i2 == i1 || (i2 < i1 && (!active || searched[i2]))) { continue; }
+
+                        double dx = bodies.x[i1]-bodies.x[i2];
+                        double dy = bodies.y[i1]-bodies.y[i2];
+                        double r  = 10*(bodies.m[i1] + bodies.m[i2]);
+
+                        // the circles overlap if the distance between the centres is smaller than the sum of the radii
+                        if(dx*dx + dy*dy < r*r) { found.push_back( {std::min(i1, i2), std::max(i1, i2)} ); }
+                    }
+                }
+            }
+        }
+
+        // buckets are visited in hash order, so sort to make the order independent of the hash
+        std::sort(found.begin(), found.end());
+    });
+
+    for(int t = 0; t < tiles; t++) {
+
+        pairs.insert(pairs.end(), tile_pairs[t].begin(), tile_pairs[t].end());
+    }
+}
+
+int Collision_Finder::root(int i) {
+
+    // path halving keeps the trees shallow
+    while(parent[i] != i) {
+
+        parent[i] = parent[parent[i]];
+        i         = parent[i];
+    }
+
+    return i;
+}
+
+int Collision_Finder::merge(Body_Store &bodies, const std::vector<std::array<int, 2>> &pairs) {
+
+    if(pairs.empty()) { return 0; }
+
+    int n = bodies.size();
+
+    // union each colliding pair, keeping the heaviest body (lowest index on a tie) as the root - only
+    // the bodies in pairs are touched, so merging a few bodies costs nothing per body that isn't
+    if((int) parent.size() < n) { parent.resize(n); absorbed.resize(n); }
+
+    for(const std::array<int, 2> &pair : pairs) {
+        for(int i : pair) { parent[i] = i; absorbed[i] = false; }
+    }
+
+    for(const std::array<int, 2> &pair : pairs) {
+
+        int a = root(pair[0]);
+        int b = root(pair[1]);
+
+        if(a == b) { continue; }
+
+        bool a_heavier = bodies.m[a] > bodies.m[b] || (bodies.m[a] == bodies.m[b] && a < b);
+        if(a_heavier) { parent[b] = a; } else { parent[a] = b; }
+    }
+
+    // sum the mass and momentum of each group into its root - the root keeps its position
+    gone.clear();
+
+    for(const std::array<int, 2> &pair : pairs) {
+        for(int i : pair) {
+
+            int r = root(i);
+            if(r == i || absorbed[i]) { continue; }
+
+            double m       = bodies.m[r] + bodies.m[i];
+            bodies.vx[r]   = (bodies.m[r]*bodies.vx[r] + bodies.m[i]*bodies.vx[i]) / m;
+            bodies.vy[r]   = (bodies.m[r]*bodies.vy[r] + bodies.m[i]*bodies.vy[i]) / m;
+            bodies.m[r]    = m;
+            absorbed[i]    = true;
+            gone.push_back(i);
+        }
+    }
+
+    int removed = gone.size();
+    bodies.remove(gone);
+
+    return removed;
+}
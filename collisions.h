@@ -0,0 +1,49 @@
+#ifndef COLLISIONS_H
+#define COLLISIONS_H
+
+#include "body.h"
+#include "thread_pool.h"
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+// finds and merges colliding bodies - a spatial hash with cells as wide as the largest body means
+// each body is only tested against bodies in its own and the 8 neighbouring cells, so the cost
+// scales with the number of nearby bodies rather than with N^2
+class Collision_Finder {
+
+public:
+    // fills pairs with every pair of bodies whose circles overlap, sorted by first index
+    void find(const Body_Store &bodies, Thread_Pool &pool, std::vector<std::array<int, 2>> &pairs);
+
+    // as above but only the pairs with at least one body in active - the hash is still built over
+    // every body, but only the neighbourhoods of the active bodies are searched
+    void find(const Body_Store &bodies, const std::vector<int> &active, Thread_Pool &pool,
+              std::vector<std::array<int, 2>> &pairs);
+
+    // merges each connected group of colliding bodies into its heaviest member, conserving mass and
+    // momentum, then swaps the absorbed bodies out - returns the number of bodies removed
+    int merge(Body_Store &bodies, const std::vector<std::array<int, 2>> &pairs);
+
+protected:
+    uint32_t hash(int64_t cx, int64_t cy) const;
+    bool     build(const Body_Store &bodies); // sorts the bodies into the hash - false if no pair can touch
+    void     search(const Body_Store &bodies, const std::vector<int> *active, Thread_Pool &pool,
+                    std::vector<std::array<int, 2>> &pairs);
+    int      root(int i);
+
+    double                                       cell;        // width of a cell of the hash
+    uint32_t                                     mask;        // number of buckets - 1, a power of 2 minus 1
+    std::vector<uint32_t>                        bucket;      // bucket of each body
+    std::vector<int>                             start;       // bodies in bucket b are order[start[b] .. start[b+1]]
+    std::vector<int>                             order;       // bodies sorted by bucket
+    std::vector<std::vector<std::array<int, 2>>> tile_pairs;  // pairs found by each tile
+    std::vector<char>                            searched;    // true for the bodies whose neighbourhoods are searched
+
+    std::vector<int>                             parent;      // union-find forest over colliding bodies, set for bodies in pairs
+    std::vector<char>                            absorbed;    // true for bodies merged into another, set for bodies in pairs
+    std::vector<int>                             gone;        // bodies merged into another
+};
+
+#endif /* COLLISIONS_H */
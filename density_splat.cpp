@@ -0,0 +1,249 @@
+#include "density_splat.h"
+#include "simd.h"
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+
+// SSE2 is part of x86-64, so it needs no check at runtime - the loops are bound by memory well
+// before the width of the registers matters, so there is no AVX2 build of them
+#if defined(__SSE2__)
+typedef Sse2_d Splat_d;
+typedef Sse2_f Splat_f;
+#else
+typedef Scalar_d Splat_d;
+typedef Scalar_f Splat_f;
+#endif
+
+// number of bodies in each tile handed to a thread while projecting them
+static const int splat_tile = 4096;
+
+// number of pixels tone mapped at once, through a buffer of ramp indices on the stack
+static const int tone_chunk = 256;
+
+// finds the pixel coordinates and radius of bodies [begin, end)
+template<class R>
+static int project(const Draw_Snapshot &snapshot, int begin, int end, double zoom, const std::vector<double> &centre,
+                   double *px, double *py, double *radius) {
+
+    typename R::reg z  = R::set1(zoom);
+    typename R::reg cx = R::set1(centre[0]);
+    typename R::reg cy = R::set1(centre[1]);
+    typename R::reg rz = R::set1(10 * zoom);
+    typename R::reg sz = R::set1(2.5 * zoom);  // half the width of the stroke drawn around a circle
+
+    int i = begin;
+
+    for(; i + R::width <= end; i += R::width) {
+
+        R::store(px + i,     R::madd(R::load(&snapshot.x[i]), z, cx));
+        R::store(py + i,     R::madd(R::load(&snapshot.y[i]), z, cy));
+        R::store(radius + i, R::madd(R::load(&snapshot.m[i]), rz, sz));
+    }
+
+    return i;
+}
+
+// writes the ramp index of pixels [0, count) of a row of coverage into index
+template<class R>
+static int ramp_indices(const float *coverage, int count, int *index) {
+
+    typename R::reg k     = R::set1(Density_Splat::knee);
+    typename R::reg scale = R::set1(Density_Splat::ramp_steps - 1);
+    typename R::reg half  = R::set1(0.5f);
+
+    int x = 0;
+
+    // brightness d/(d + knee) rises steeply for the first bodies in a pixel and levels off for dense ones
+    for(; x + R::width <= count; x += R::width) {
+
+        typename R::reg d = R::load(coverage + x);
+        R::store_int(index + x, R::madd(R::div(d, R::add(d, k)), scale, half));
+    }
+
+    return x;
+}
+
+Density_Splat::Density_Splat(int threads) :
+    pool(threads),
+    ramp(ramp_steps) {
+
+    // from the green of the circles' outlines at low density to white at the densest, premultiplied
+    const double colour[3] = {0.4, 0.8, 0.1};
+
+    for(int s = 0; s < ramp_steps; s++) {
+
+        double   v     = (double) s / (ramp_steps - 1);
+        double   white = v * v * v;
+        uint32_t pixel = (uint32_t) std::lround(255 * v) << 24;
+
+        for(int c = 0; c < 3; c++) {
+
+            pixel |= (uint32_t) std::lround(255 * v * (colour[c] + (1 - colour[c]) * white)) << (16 - 8*c);
+        }
+
+        ramp[s] = pixel;
+    }
+}
+
+void Density_Splat::splat(const Draw_Snapshot &snapshot, int width, int height, double zoom,
+                          const std::vector<double> &centre) {
+
+    int n     = snapshot.m.size();
+    int bands = (height + band_rows - 1) / band_rows;
+    int tiles = (n + splat_tile - 1) / splat_tile;
+
+    this->width  = width;
+    this->height = height;
+
+    density.resize((size_t) width * height);
+    px.resize(n);
+    py.resize(n);
+    radius.resize(n);
+    area.resize(n);
+    band.resize(n);
+    tile_counts.assign((size_t) tiles * bands, 0);
+    tile_large.resize(tiles);
+    large.clear();
+    culled = 0;
+
+    if(bands == 0 || width <= 0) { return; }
+
+    // put every body in view, then count the bodies of each tile which land in each band
+    pool.run(tiles, [&](int t, int) {
+
+        int  begin  = t * splat_tile;
+        int  end    = std::min(begin + splat_tile, n);
+        int *counts = &tile_counts[(size_t) t * bands];
+
+        int done = project<Splat_d>(snapshot, begin, end, zoom, centre, px.data(), py.data(), radius.data());
+        project<Scalar_d>(snapshot, done, end, zoom, centre, px.data(), py.data(), radius.data());
+
+        tile_large[t].clear();
+
+        for(int i = begin; i < end; i++) {
+
+            double r = radius[i];
+            band[i]  = -1;
+
+            if(px[i] + r < 0 || px[i] - r > width || py[i] + r < 0 || py[i] - r > height) { continue; }
+            if(r > max_radius) { tile_large[t].push_back(i); continue; }
+
+            // the pixel centres are at half pixels, and the body's row is the upper of the two it touches
+            int row = std::floor(py[i] - 0.5);
+            band[i] = std::min(std::max(row, 0) / band_rows, bands - 1);
+            area[i] = std::max(M_PI * r * r, min_area);
+            counts[band[i]]++;
+        }
+    });
+
+    // turn the counts into where each tile's bodies start in their band, band by band and tile by tile
+    band_start.resize(bands + 1);
+    int placed = 0;
+
+    for(int b = 0; b < bands; b++) {
+
+        band_start[b] = placed;
+
+        for(int t = 0; t < tiles; t++) {
+
+            int count = tile_counts[(size_t) t * bands + b];
+            tile_counts[(size_t) t * bands + b] = placed;
+            placed += count;
+        }
+    }
+
+    band_start[bands] = placed;
+    band_bodies.resize(placed);
+
+    for(int t = 0; t < tiles; t++) {
+
+        large.insert(large.end(), tile_large[t].begin(), tile_large[t].end());
+    }
+
+    culled = n - placed - large.size();
+
+    pool.run(tiles, [&](int t, int) {
+
+        int  end     = std::min((t+1) * splat_tile, n);
+        int *cursors = &tile_counts[(size_t) t * bands];
+
+        for(int i = t * splat_tile; i < end; i++) {
+
+            if(band[i] >= 0) { band_bodies[cursors[band[i]]++] = i; }
+        }
+    });
+
+    pool.run(bands, [&](int b, int) {
+
+        int last = std::min((b+1) * band_rows, height);
+        std::fill(density.begin() + (size_t) b * band_rows * width, density.begin() + (size_t) last * width, 0.0f);
+    });
+
+    // splat the even bands, then the odd ones, so no two threads ever add to the same row
+    for(int parity = 0; parity < 2; parity++) {
+
+        pool.run((bands + 1 - parity) / 2, [&](int k, int) {
+
+            int b = 2*k + parity;
+
+            for(int e = band_start[b]; e < band_start[b+1]; e++) {
+
+                int    i  = band_bodies[e];
+                double sx = px[i] - 0.5;
+                double sy = py[i] - 0.5;
+                int    x0 = std::floor(sx);
+                int    y0 = std::floor(sy);
+                float  fx = sx - x0;
+                float  fy = sy - y0;
+                float  a  = area[i];
+
+                // cloud in cell - each of the four pixels gets the share of the body nearest it
+                float shares[2][2] = { {a*(1-fx)*(1-fy), a*fx*(1-fy)}, {a*(1-fx)*fy, a*fx*fy} };
+
+                for(int dy = 0; dy < 2; dy++) {
+
+                    int y = y0 + dy;
+                    if(y < 0 || y >= height) { continue; }
+
+                    float *row = &density[(size_t) y * width];
+
+                    for(int dx = 0; dx < 2; dx++) {
+
+                        int x = x0 + dx;
+                        if(x >= 0 && x < width) { row[x] += shares[dy][dx]; }
+                    }
+                }
+            }
+        });
+    }
+}
+
+void Density_Splat::tone_map(unsigned char *pixels, int stride) {
+
+    int bands = (height + band_rows - 1) / band_rows;
+
+    pool.run(bands, [&](int b, int) {
+
+        int last = std::min((b+1) * band_rows, height);
+        int index[tone_chunk];
+
+        for(int y = b * band_rows; y < last; y++) {
+
+            const float *coverage = &density[(size_t) y * width];
+            uint32_t    *row      = (uint32_t *) (pixels + (size_t) y * stride);
+
+            for(int begin = 0; begin < width; begin += tone_chunk) {
+
+                int count = std::min(tone_chunk, width - begin);
+                int x     = ramp_indices<Splat_f>(coverage + begin, count, index);
+
+                // the last few pixels of the chunk one at a time
+                ramp_indices<Scalar_f>(coverage + begin + x, count - x, index + x);
+
+                for(int k = 0; k < count; k++) { row[begin + k] = ramp[index[k]]; }
+            }
+        }
+    });
+}
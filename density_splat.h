@@ -0,0 +1,62 @@
+#ifndef DENSITY_SPLAT_H
+#define DENSITY_SPLAT_H
+
+#include "draw_snapshot.h"
+#include "thread_pool.h"
+#include <vector>
+#include <cstdint>
+
+
+// draws bodies as the brightness of the pixels they land in rather than one at a time - each body
+// adds its area to the four pixels around its centre, weighted by how close it is to each, into a
+// buffer of floats the size of the view, which a colour ramp then turns into 32 bit pixels. The cost
+// is one pass over the bodies in view and one over the pixels however much the bodies overlap, so it
+// stands in for circles once there are too many bodies to tell apart.
+//
+// The view is cut into bands of rows and the bodies are sorted by band, keeping their order, so the
+// threads each splat whole bands - every other band at once, since a body can touch the first row
+// of the band below its own - and the result doesn't depend on the number of threads
+class Density_Splat {
+
+public:
+    explicit Density_Splat(int threads = 0); // 0 uses one thread per hardware thread
+
+    void set_threads(int threads) { pool.resize(threads); } // restarts the worker threads
+
+    // clears the buffer to width by height pixels and adds every body in view - bodies larger than
+    // max_radius pixels are listed in large instead, to be drawn as circles
+    void splat(const Draw_Snapshot &snapshot, int width, int height, double zoom, const std::vector<double> &centre);
+
+    // writes the buffer as cairo's premultiplied ARGB32 pixels, with rows stride bytes apart
+    void tone_map(unsigned char *pixels, int stride);
+
+    std::vector<int> large;        // bodies in view too large to splat, in increasing order
+    long             culled = 0;   // bodies outside the view in the last splat
+
+    static constexpr double max_radius = 1.5;  // radius in pixels, stroke included, above which a body is left to circles
+    static constexpr double min_area   = 0.25; // least area in pixels a body adds, so a lone body is still seen
+    static constexpr float  knee       = 0.5;  // coverage shown at half brightness - a covered pixel counts 1
+    static const     int    band_rows  = 32;   // rows in each band handed to a thread
+    static const     int    ramp_steps = 1024; // colours in the ramp from empty to dense
+
+protected:
+    Thread_Pool                    pool;
+    int                            width  = 0;
+    int                            height = 0;
+    std::vector<float>             density;      // coverage of each pixel, row by row
+
+    std::vector<double>            px;           // pixel coordinates of each body
+    std::vector<double>            py;
+    std::vector<double>            radius;       // radius of each body in pixels, stroke included
+    std::vector<float>             area;         // coverage each body adds
+    std::vector<int>               band;         // band of each body, -1 if it isn't splatted
+
+    std::vector<int>               tile_counts;  // bodies of each tile in each band, then where they start in band_bodies
+    std::vector<std::vector<int>>  tile_large;   // large bodies of each tile
+    std::vector<int>               band_start;   // bodies of band b are band_bodies[band_start[b] .. band_start[b+1]]
+    std::vector<int>               band_bodies;
+
+    std::vector<uint32_t>          ramp;         // pixel for each step of brightness
+};
+
+#endif /* DENSITY_SPLAT_H */
@@ -0,0 +1,31 @@
+#include "direct_kernel.h"
+#include "direct_kernel_impl.h"
+
+
+// defined in direct_kernel_avx2.cpp, which is compiled with -mavx2 -mfma
+Direct_Kernel select_direct_kernel_avx2(const Kernel_Policy &policy);
+
+Direct_Kernel select_direct_kernel(const Kernel_Policy &policy, const char **name) {
+
+    const char   *chosen = policy.single ? "scalar float" : "scalar";
+    Direct_Kernel kernel = policy.single ? specialise<Scalar_f>(policy) : specialise<Scalar_d>(policy);
+
+#if defined(__SSE2__)
+    chosen = policy.single ? "SSE2 float" : "SSE2";
+    kernel = policy.single ? specialise<Sse2_f>(policy) : specialise<Sse2_d>(policy);
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+
+        chosen = policy.single ? "AVX2 float" : "AVX2";
+        kernel = select_direct_kernel_avx2(policy);
+    }
+#endif
+
+    if(name) { *name = chosen; }
+
+    return kernel;
+}
@@ -0,0 +1,49 @@
+#ifndef DIRECT_KERNEL_H
+#define DIRECT_KERNEL_H
+
+#include <vector>
+#include <array>
+
+
+// what a kernel is specialised for - every combination is an instantiation of its own, so nothing
+// about the policy is tested inside the loop over pairs
+struct Kernel_Policy {
+
+    bool single    = false; // float arithmetic on positions relative to an origin, twice the lanes of double
+    bool cutoff    = true;  // ignore pairs further apart than the cutoff
+    bool softening = false; // use d^2 + softening^2 in place of d^2, so that no pair is singular
+    bool contacts  = false; // also list the pairs of bodies which touch, from the distances already found
+
+    bool operator==(const Kernel_Policy &other) const {
+
+        return single == other.single && cutoff == other.cutoff && softening == other.softening && contacts == other.contacts;
+    }
+};
+
+// the bodies and settings a kernel runs on - the float copies are only read by single precision kernels
+struct Kernel_Input {
+
+    const double *x;          // positions and masses of the n bodies
+    const double *y;
+    const double *m;
+    const float  *fx;         // float copies of the positions, relative to an origin, and masses
+    const float  *fy;
+    const float  *fm;
+    int           n;
+    double        cutoff;     // pairs further apart are ignored if the policy has a cutoff
+    double        softening;  // softening length if the policy has softening
+    const char   *rows;       // with contacts, true for each body whose row is summed, or null if every row is
+};
+
+// adds the acceleration of bodies [begin, end) due to all n bodies of in into ax and ay - with contacts,
+// also appends to contacts each pair of a body in [begin, end) and a partner closer than the sum of their
+// radii of 10*mass, lowest index first and exactly as the collision finder tests them. A pair of two
+// summed rows is only listed from the lower one
+typedef void (*Direct_Kernel)(const Kernel_Input &in, int begin, int end, double *ax, double *ay,
+                              std::vector<std::array<int, 2>> *contacts);
+
+// picks the widest kernel the cpu supports - AVX2, SSE2 or scalar - specialised for policy, and
+// optionally its name
+Direct_Kernel select_direct_kernel(const Kernel_Policy &policy = Kernel_Policy(), const char **name = nullptr);
+
+#endif /* DIRECT_KERNEL_H */
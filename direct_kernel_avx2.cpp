@@ -0,0 +1,13 @@
+#include "direct_kernel.h"
+#include "direct_kernel_impl.h"
+
+
+// only ever called after select_direct_kernel() has checked the cpu supports AVX2 and FMA
+Direct_Kernel select_direct_kernel_avx2(const Kernel_Policy &policy) {
+
+#if defined(__AVX2__) && defined(__FMA__)
+    return policy.single ? specialise<Avx2_f>(policy) : specialise<Avx2_d>(policy);
+#else
+    return policy.single ? specialise<Scalar_f>(policy) : specialise<Scalar_d>(policy);
+#endif
+}
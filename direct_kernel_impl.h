@@ -0,0 +1,130 @@
+#ifndef DIRECT_KERNEL_IMPL_H
+#define DIRECT_KERNEL_IMPL_H
+
+#include "direct_kernel.h"
+#include "simd.h"
+#include <algorithm>
+
+
+// partner bodies are processed in blocks small enough that their positions and masses
+// stay in cache while every row in [begin, end) is swept over them
+const int direct_block = 4096;
+
+// the arrays of in a kernel of each precision reads
+inline void kernel_arrays(const Kernel_Input &in, const double *&x, const double *&y, const double *&m) { x = in.x;  y = in.y;  m = in.m; }
+inline void kernel_arrays(const Kernel_Input &in, const float  *&x, const float  *&y, const float  *&m) { x = in.fx; y = in.fy; m = in.fm; }
+
+// lists the pairs of body i and partners [begin, end) which touch, in double precision whatever the kernel's -
+// only called for the few registers of partners in which a lane looks close enough
+inline void touching(const Kernel_Input &in, int i, int begin, int end, std::vector<std::array<int, 2>> &contacts) {
+
+    for(int j = begin; j < end; j++) {
+
+        if(j == i || (j < i && (!in.rows || in.rows[j]))) { continue; }
+
+        double dx = in.x[i]-in.x[j];
+        double dy = in.y[i]-in.y[j];
+        double r  = 10*(in.m[i] + in.m[j]);
+
+        if(dx*dx + dy*dy < r*r) { contacts.push_back( {std::min(i, j), std::max(i, j)} ); }
+    }
+}
+
+template<class V, bool Cutoff, bool Softening, bool Contacts>
+void direct_rows(const Kernel_Input &in, int begin, int end, double *ax, double *ay, std::vector<std::array<int, 2>> *contacts) {
+
+    typedef typename V::scalar T;
+    typedef typename V::reg    reg;
+
+    const T *x, *y, *m;
+    kernel_arrays(in, x, y, m);
+
+    int n = in.n;
+
+    const T   cutoff2    = in.cutoff * in.cutoff;
+    const T   softening2 = in.softening * in.softening;
+    const reg g          = V::set1(100);
+    const reg c2         = V::set1(cutoff2);
+    const reg e2         = V::set1(softening2);
+    const reg ten        = V::set1(10);
+    const reg slack      = V::set1(1.001);  // so rounding in float never hides a touching pair from the double test
+
+    for(int jb = 0; jb < n; jb += direct_block) {
+
+        int je         = std::min(jb + direct_block, n);
+        int vector_end = jb + (je - jb) / V::width * V::width;
+
+        for(int i = begin; i < end; i++) {
+
+            reg xi = V::set1(x[i]);
+            reg yi = V::set1(y[i]);
+            reg sx = V::zero();
+            reg sy = V::zero();
+            reg mi = V::set1(m[i]);
+
+            // V::width partner bodies per iteration
+            for(int j = jb; j < vector_end; j += V::width) {
+
+                reg dx = V::sub(V::load(x + j), xi);
+                reg dy = V::sub(V::load(y + j), yi);
+                reg d2 = V::madd(dx, dx, V::mul(dy, dy));
+
+                // 100 * m / d^3 - the mask drops the body itself and pairs beyond the cutoff, and without a
+                // cutoff softening needs no mask at all, since it keeps d^2 above 0 and the body's own dx, dy are 0
+                reg s  = V::over_cube(V::mul(g, V::load(m + j)), Softening ? V::add(d2, e2) : d2);
+
+                if(Cutoff)          { s = V::keep_if(s, d2, c2); }
+                else if(!Softening) { s = V::keep_nonzero(s, d2); }
+
+                sx     = V::madd(s, dx, sx);
+                sy     = V::madd(s, dy, sy);
+
+                // the distance is already there, so touching only costs a compare - the body itself always passes
+                if(Contacts) {
+
+                    reg r = V::mul(ten, V::add(mi, V::load(m + j)));
+                    if(V::any_less(d2, V::mul(slack, V::mul(r, r)))) { touching(in, i, j, j + V::width, *contacts); }
+                }
+            }
+
+            if(Contacts) { touching(in, i, vector_end, je, *contacts); }
+
+            double tx = V::sum(sx);
+            double ty = V::sum(sy);
+
+            // leftover partners which don't fill a register
+            for(int j = vector_end; j < je; j++) {
+
+                T dx = x[j] - x[i];
+                T dy = y[j] - y[i];
+                T d2 = dx*dx + dy*dy;
+
+                if(d2 == 0 || (Cutoff && d2 > cutoff2)) { continue; }
+
+                T e  = Softening ? d2 + softening2 : d2;
+                T s  = 100 * m[j] / (e * std::sqrt(e));
+                tx  += s*dx;
+                ty  += s*dy;
+            }
+
+            ax[i] += tx;
+            ay[i] += ty;
+        }
+    }
+}
+
+// the instantiation of direct_rows for the policy, with registers V of the right precision
+template<class V, bool Contacts>
+Direct_Kernel specialise_contacts(const Kernel_Policy &policy) {
+
+    if(policy.cutoff) { return policy.softening ? direct_rows<V, true,  true,  Contacts> : direct_rows<V, true,  false, Contacts>; }
+    else              { return policy.softening ? direct_rows<V, false, true,  Contacts> : direct_rows<V, false, false, Contacts>; }
+}
+
+template<class V>
+Direct_Kernel specialise(const Kernel_Policy &policy) {
+
+    return policy.contacts ? specialise_contacts<V, true>(policy) : specialise_contacts<V, false>(policy);
+}
+
+#endif /* DIRECT_KERNEL_IMPL_H */
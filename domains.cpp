@@ -0,0 +1,506 @@
+#include "domains.h"
+#include "forces.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <cmath>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// gravitational constant of the force law, f = 100 m1 m2 / d^2
+static const double G = 100;
+
+// header of a request to a worker, followed by x, y and m of its bodies then its ghosts, the index of
+// each body whose acceleration is wanted, and the summaries of the domains it doesn't get the bodies of
+struct Domain_Request {
+
+    int32_t owned;
+    int32_t ghosts;
+    int32_t targets;
+    int32_t summaries;
+    int32_t single;
+    int32_t whole;      // 1 if every body of the domain is a target, in order
+    double  cutoff;
+    double  softening;
+};
+
+// header of a worker's reply, followed by ax then ay of each target
+struct Domain_Reply {
+
+    int64_t interactions;
+};
+
+static bool send_all(int fd, const void *data, size_t bytes) {
+
+    const char *p = (const char *) data;
+
+    while(bytes > 0) {
+
+        ssize_t sent = ::send(fd, p, bytes, MSG_NOSIGNAL);
+
+        if(sent < 0 && errno == EINTR) { continue; }
+        if(sent <= 0) { return false; }
+
+        p     += sent;
+        bytes -= sent;
+    }
+
+    return true;
+}
+
+static bool receive_all(int fd, void *data, size_t bytes) {
+
+    char *p = (char *) data;
+
+    while(bytes > 0) {
+
+        ssize_t got = ::recv(fd, p, bytes, 0);
+
+        if(got < 0 && errno == EINTR) { continue; }
+        if(got <= 0) { return false; }
+
+        p     += got;
+        bytes -= got;
+    }
+
+    return true;
+}
+
+// appends the bytes of count values to buffer
+template<class T>
+static void append(std::vector<char> &buffer, const T *values, size_t count) {
+
+    const char *p = (const char *) values;
+    buffer.insert(buffer.end(), p, p + count * sizeof(T));
+}
+
+// acceleration at x, y from a summarised domain - its mass at the centre of mass plus the quadrupole term
+template<class Summary>
+static void add_summary(const Summary &s, double x, double y, double e2, double &ax, double &ay) {
+
+    double rx = x - s.cx;
+    double ry = y - s.cy;
+    double r2 = rx*rx + ry*ry + e2;
+    double r  = std::sqrt(r2);
+    double r3 = r2 * r;
+    double r5 = r3 * r2;
+
+    double qx  = s.qxx*rx + s.qxy*ry;
+    double qy  = s.qxy*rx + s.qyy*ry;
+    double rqr = rx*qx + ry*qy;
+
+    ax += G * (-s.mass * rx / r3 + qx / r5 - 2.5 * rqr * rx / (r5 * r2));
+    ay += G * (-s.mass * ry / r3 + qy / r5 - 2.5 * rqr * ry / (r5 * r2));
+}
+
+// runs in each worker process until the coordinator closes its end of the socket
+template<class Summary>
+static void serve(int fd) {
+
+    Thread_Pool         pool(1);
+    Direct_Sum          direct;
+    Body_Store          bodies;
+    std::vector<int>    targets;
+    std::vector<Summary> summaries;
+    std::vector<double> ax, ay, reply;
+
+    Domain_Request request;
+
+    while(receive_all(fd, &request, sizeof(request))) {
+
+        int n = request.owned + request.ghosts;
+
+        bodies.x.resize(n);
+        bodies.y.resize(n);
+        bodies.m.resize(n);
+        targets.resize(request.targets);
+        summaries.resize(request.summaries);
+
+        if(!receive_all(fd, bodies.x.data(), n * sizeof(double)) ||
+           !receive_all(fd, bodies.y.data(), n * sizeof(double)) ||
+           !receive_all(fd, bodies.m.data(), n * sizeof(double)) ||
+           !receive_all(fd, targets.data(), request.targets * sizeof(int)) ||
+           !receive_all(fd, summaries.data(), request.summaries * sizeof(Summary))) { return; }
+
+        Kernel_Policy policy;
+        policy.single    = request.single;
+        policy.cutoff    = std::isfinite(request.cutoff);
+        policy.softening = request.softening > 0;
+
+        direct.select(policy);
+
+        Kernel_Input in = direct.input(bodies, request.cutoff, request.softening, pool);
+        ax.assign(n, 0);
+        ay.assign(n, 0);
+
+        // the bodies of the domain come first, so a whole domain is one block of rows
+        if(request.whole) { direct.kernel(in, 0, request.owned, ax.data(), ay.data(), nullptr); }
+        else {
+
+            for(int i : targets) { direct.kernel(in, i, i+1, ax.data(), ay.data(), nullptr); }
+        }
+
+        double e2 = request.softening * request.softening;
+
+        reply.resize(2 * request.targets);
+
+        for(int k = 0; k < request.targets; k++) {
+
+            int i = targets[k];
+            for(const Summary &s : summaries) { add_summary(s, bodies.x[i], bodies.y[i], e2, ax[i], ay[i]); }
+
+            reply[k]                   = ax[i];
+            reply[request.targets + k] = ay[i];
+        }
+
+        Domain_Reply header;
+        header.interactions = (int64_t) request.targets * (n + request.summaries);
+
+        if(!send_all(fd, &header, sizeof(header)) || !send_all(fd, reply.data(), reply.size() * sizeof(double))) { return; }
+    }
+}
+
+Domain_Decomposition::Domain_Decomposition(int processes) {
+
+    for(int p = 0; p < processes; p++) {
+
+        int fds[2];
+
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+
+            error = std::string("couldn't create a socket for a worker: ") + std::strerror(errno);
+            return;
+        }
+
+        pid_t pid = fork();
+
+        if(pid < 0) {
+
+            error = std::string("couldn't start a worker process: ") + std::strerror(errno);
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+
+        // the worker only keeps its own end of its own socket, and leaves without running the
+        // coordinator's destructors or flushing its output
+        if(pid == 0) {
+
+            close(fds[0]);
+            for(int fd : sockets) { close(fd); }
+
+            serve<Summary>(fds[1]);
+            _exit(0);
+        }
+
+        close(fds[1]);
+        sockets.push_back(fds[0]);
+        workers.push_back(pid);
+    }
+
+    cost.assign(processes, 0);
+    members.resize(processes);
+    summaries.resize(processes);
+}
+
+Domain_Decomposition::~Domain_Decomposition() {
+
+    for(int fd : sockets) { close(fd); }
+    for(pid_t pid : workers) { waitpid(pid, nullptr, 0); }
+}
+
+int Domain_Decomposition::domain_of(double x, double y) const {
+
+    int node = 0;
+
+    while(splits[node].axis >= 0) {
+
+        const Split &s = splits[node];
+        node = (s.axis ? y : x) < s.position ? s.left : s.right;
+    }
+
+    return splits[node].domain;
+}
+
+int Domain_Decomposition::split(const Body_Store &bodies, const std::vector<double> &weight, std::vector<int> &index,
+                                int begin, int end, int first, int count) {
+
+    int node = splits.size();
+    splits.push_back(Split{-1, 0, -1, -1, first});
+
+    if(count == 1) { return node; }
+
+    // split across the longer side of the bounds of these bodies
+    double xmin = HUGE_VAL, xmax = -HUGE_VAL, ymin = HUGE_VAL, ymax = -HUGE_VAL;
+
+    for(int k = begin; k < end; k++) {
+
+        xmin = std::min(xmin, bodies.x[index[k]]);
+        xmax = std::max(xmax, bodies.x[index[k]]);
+        ymin = std::min(ymin, bodies.y[index[k]]);
+        ymax = std::max(ymax, bodies.y[index[k]]);
+    }
+
+    int axis = (end - begin > 0 && ymax - ymin > xmax - xmin) ? 1 : 0;
+    const std::vector<double> &c = axis ? bodies.y : bodies.x;
+
+    // ties are broken by index so the split doesn't depend on the sort
+    std::sort(index.begin() + begin, index.begin() + end, [&](int a, int b){ return c[a] < c[b] || (c[a] == c[b] && a < b); });
+
+    // the left side takes its share of the domains and as near as it can to the same share of the weight
+    int    left  = count / 2;
+    double total = 0;
+    for(int k = begin; k < end; k++) { total += weight[index[k]]; }
+
+    double wanted = total * left / count;
+    double sum    = 0;
+    int    cut    = begin;
+
+    while(cut < end && sum + 0.5 * weight[index[cut]] < wanted) { sum += weight[index[cut++]]; }
+
+    double position;
+
+    if(cut == begin)    { position = end > begin ? c[index[begin]] : 0; }
+    else if(cut == end) { position = std::nextafter(c[index[end-1]], HUGE_VAL); }
+    else                { position = 0.5 * (c[index[cut-1]] + c[index[cut]]); }
+
+    int l = split(bodies, weight, index, begin, cut, first, left);
+    int r = split(bodies, weight, index, cut, end, first + left, count - left);
+
+    splits[node] = Split{axis, position, l, r, -1};
+
+    return node;
+}
+
+void Domain_Decomposition::bisect(const Body_Store &bodies) {
+
+    int n = bodies.size();
+    int p = processes();
+
+    // weight each body with the cost per body of the domain it is in now, once there are costs to go on
+    std::vector<double> weight(n, 1);
+
+    if(!splits.empty() && std::accumulate(cost.begin(), cost.end(), 0.0) > 0) {
+
+        std::vector<int> count(p, 0);
+        owner.resize(n);
+
+        for(int i = 0; i < n; i++) { count[owner[i] = domain_of(bodies.x[i], bodies.y[i])]++; }
+        for(int i = 0; i < n; i++) { weight[i] = std::max(cost[owner[i]] / count[owner[i]], 1.0); }
+    }
+
+    std::vector<int> index(n);
+    std::iota(index.begin(), index.end(), 0);
+
+    splits.clear();
+    split(bodies, weight, index, 0, n, 0, p);
+
+    split_bodies = n;
+    bisections++;
+}
+
+long Domain_Decomposition::accelerations(const Body_Store &bodies, double cutoff, double softening, double theta, bool single,
+                                         std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+    int p = processes();
+
+    if(splits.empty() || n != split_bodies) { bisect(bodies); }
+
+    owner.resize(n);
+    for(auto &m : members) { m.clear(); }
+
+    for(int i = 0; i < n; i++) { members[owner[i] = domain_of(bodies.x[i], bodies.y[i])].push_back(i); }
+
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    long interactions = exchange(bodies, members, cutoff, softening, theta, single, ax, ay);
+
+    // find the domains again before the next evaluation if one of them is doing too much of the work
+    double most = *std::max_element(cost.begin(), cost.end());
+    double mean = std::accumulate(cost.begin(), cost.end(), 0.0) / p;
+
+    if(most > max_imbalance * mean) { split_bodies = -1; }
+
+    return interactions;
+}
+
+long Domain_Decomposition::accelerations(const Body_Store &bodies, const std::vector<int> &active, double cutoff,
+                                         double softening, double theta, bool single, std::vector<double> &ax,
+                                         std::vector<double> &ay) {
+
+    int n = bodies.size();
+    int p = processes();
+
+    if(splits.empty() || n != split_bodies) { bisect(bodies); }
+
+    owner.resize(n);
+    for(auto &m : members) { m.clear(); }
+
+    for(int i = 0; i < n; i++) { members[owner[i] = domain_of(bodies.x[i], bodies.y[i])].push_back(i); }
+
+    // the costs are only kept from whole evaluations, which are spread like the block steps' aren't
+    std::vector<double> whole_cost = cost;
+    std::vector<std::vector<int>> targets(p);
+    for(int i : active) { targets[owner[i]].push_back(i); }
+
+    ax.resize(n);
+    ay.resize(n);
+
+    long interactions = exchange(bodies, targets, cutoff, softening, theta, single, ax, ay);
+    cost = whole_cost;
+
+    return interactions;
+}
+
+long Domain_Decomposition::exchange(const Body_Store &bodies, const std::vector<std::vector<int>> &targets, double cutoff,
+                                    double softening, double theta, bool single, std::vector<double> &ax,
+                                    std::vector<double> &ay) {
+
+    int p = processes();
+
+    // bounds, mass and moments of each domain
+    for(int d = 0; d < p; d++) {
+
+        Summary &s = summaries[d];
+        s = Summary{HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL, 0, 0, 0, 0, 0, 0};
+
+        for(int i : members[d]) {
+
+            s.xmin  = std::min(s.xmin, bodies.x[i]);
+            s.xmax  = std::max(s.xmax, bodies.x[i]);
+            s.ymin  = std::min(s.ymin, bodies.y[i]);
+            s.ymax  = std::max(s.ymax, bodies.y[i]);
+            s.mass += bodies.m[i];
+            s.cx   += bodies.m[i] * bodies.x[i];
+            s.cy   += bodies.m[i] * bodies.y[i];
+        }
+
+        if(s.mass > 0) { s.cx /= s.mass; s.cy /= s.mass; }
+
+        for(int i : members[d]) {
+
+            double dx = bodies.x[i] - s.cx;
+            double dy = bodies.y[i] - s.cy;
+
+            s.qxx += bodies.m[i] * (2*dx*dx - dy*dy);
+            s.qyy += bodies.m[i] * (2*dy*dy - dx*dx);
+            s.qxy += bodies.m[i] * 3*dx*dy;
+        }
+    }
+
+    // distance from a point to the bounds of a domain, 0 inside them
+    auto distance = [&](const Summary &s, double x, double y) {
+
+        double dx = std::max(0.0, std::max(s.xmin - x, x - s.xmax));
+        double dy = std::max(0.0, std::max(s.ymin - y, y - s.ymax));
+        return std::sqrt(dx*dx + dy*dy);
+    };
+
+    std::vector<char> buffer;
+    std::vector<int>  slot(bodies.size());
+    std::vector<int>  sent(p, 0);
+
+    for(int d = 0; d < p; d++) {
+
+        if(targets[d].empty()) { continue; }
+
+        const Summary   &own = summaries[d];
+        std::vector<int> source(members[d]);
+        std::vector<int> rows;
+        std::vector<Summary> far;
+
+        for(int k = 0; k < (int) members[d].size(); k++) { slot[members[d][k]] = k; }
+
+        // the ghosts and summaries of every other domain, as seen from this one
+        for(int e = 0; e < p; e++) {
+
+            const Summary &other = summaries[e];
+            if(e == d || members[e].empty()) { continue; }
+
+            double gap_x = std::max(0.0, std::max(other.xmin - own.xmax, own.xmin - other.xmax));
+            double gap_y = std::max(0.0, std::max(other.ymin - own.ymax, own.ymin - other.ymax));
+
+            if(std::isfinite(cutoff)) {
+
+                if(std::sqrt(gap_x*gap_x + gap_y*gap_y) > cutoff) { continue; }
+
+                for(int j : members[e]) {
+
+                    if(distance(own, bodies.x[j], bodies.y[j]) <= cutoff) { source.push_back(j); }
+                }
+            }
+            else {
+
+                double size = std::max(other.xmax - other.xmin, other.ymax - other.ymin);
+
+                if(size < theta * distance(own, other.cx, other.cy)) { far.push_back(other); }
+                else { source.insert(source.end(), members[e].begin(), members[e].end()); }
+            }
+        }
+
+        bool whole = targets[d].size() == members[d].size();
+        for(int i : targets[d]) { rows.push_back(slot[i]); }
+
+        Domain_Request request;
+        request.owned     = members[d].size();
+        request.ghosts    = source.size() - members[d].size();
+        request.targets   = rows.size();
+        request.summaries = far.size();
+        request.single    = single;
+        request.whole     = whole;
+        request.cutoff    = cutoff;
+        request.softening = softening;
+
+        buffer.clear();
+        append(buffer, &request, 1);
+        for(int j : source) { append(buffer, &bodies.x[j], 1); }
+        for(int j : source) { append(buffer, &bodies.y[j], 1); }
+        for(int j : source) { append(buffer, &bodies.m[j], 1); }
+        append(buffer, rows.data(), rows.size());
+        append(buffer, far.data(), far.size());
+
+        if(!send_all(sockets[d], buffer.data(), buffer.size())) {
+
+            throw std::runtime_error("worker process " + std::to_string(d) + " stopped taking requests");
+        }
+
+        sent[d] = 1;
+    }
+
+    // the workers all sum at once, then each reply is read in turn
+    long                interactions = 0;
+    std::vector<double> reply;
+
+    for(int d = 0; d < p; d++) {
+
+        if(!sent[d]) { cost[d] = 0; continue; }
+
+        Domain_Reply header;
+        int          count = targets[d].size();
+        reply.resize(2 * count);
+
+        if(!receive_all(sockets[d], &header, sizeof(header)) || !receive_all(sockets[d], reply.data(), reply.size() * sizeof(double))) {
+
+            throw std::runtime_error("worker process " + std::to_string(d) + " stopped responding");
+        }
+
+        for(int k = 0; k < count; k++) {
+
+            ax[targets[d][k]] = reply[k];
+            ay[targets[d][k]] = reply[count + k];
+        }
+
+        cost[d]       = header.interactions;
+        interactions += header.interactions;
+    }
+
+    return interactions;
+}
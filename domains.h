@@ -0,0 +1,93 @@
+#ifndef DOMAINS_H
+#define DOMAINS_H
+
+#include "body.h"
+#include <vector>
+#include <array>
+#include <string>
+#include <sys/types.h>
+
+
+// finds forces in worker processes, each owning a spatial domain of the bodies - the domains come from
+// orthogonal recursive bisection, splitting the bodies in two along the longer side of their bounds
+// with the estimated cost on each side in proportion to the domains it gets, and again within each side.
+//
+// For each evaluation every worker is sent over a unix socket the bodies of its domain, the bodies of
+// other domains it needs (ghosts) and a summary of the mass of those it doesn't - with a cutoff, the
+// ghosts are the bodies within the cutoff of the domain's bounds and nothing further counts, and with
+// none, a domain small enough as seen from another is sent as its mass, centre of mass and quadrupole
+// moment rather than as bodies. Workers sum each of their bodies' forces with the direct sum kernel.
+//
+// The cost of each domain is the number of pairs summed in it. The domains are bisected again once a
+// merge or an added body changes the number of bodies, or the most expensive domain costs more than
+// max_imbalance times the average, weighting each body with the cost per body of its domain - so the
+// domains, and the results, depend on the number of processes but never on timing
+class Domain_Decomposition {
+
+public:
+    explicit Domain_Decomposition(int processes); // forks the worker processes - check error before use
+    ~Domain_Decomposition();                      // closes the sockets, letting the workers exit, and waits for them
+
+    Domain_Decomposition(const Domain_Decomposition &) = delete;
+    Domain_Decomposition &operator=(const Domain_Decomposition &) = delete;
+
+    // fills ax and ay with the acceleration of every body from the bodies within cutoff (infinite for
+    // none), with distances softened over softening and domains summarised if they are smaller than
+    // theta times their distance, all in the direct sum's float kernel if single is set - returns the
+    // number of pairs and summaries summed. Throws std::runtime_error if a worker stops responding
+    long accelerations(const Body_Store &bodies, double cutoff, double softening, double theta, bool single,
+                       std::vector<double> &ax, std::vector<double> &ay);
+
+    // as above for only the active bodies, keeping the domains unless the bodies have been renumbered
+    long accelerations(const Body_Store &bodies, const std::vector<int> &active, double cutoff, double softening,
+                       double theta, bool single, std::vector<double> &ax, std::vector<double> &ay);
+
+    int processes() const { return sockets.size(); }
+
+    long        bisections = 0;  // number of times the domains have been found again
+    std::string error;           // why the workers couldn't be started, empty if they were
+
+    static constexpr double max_imbalance = 1.2;
+
+protected:
+    // node of the bisection - bodies below position along axis go to left, the rest to right, down to a domain
+    struct Split {
+
+        int    axis;     // 0 for x, 1 for y, -1 for a leaf
+        double position;
+        int    left;
+        int    right;
+        int    domain;   // domain of a leaf
+    };
+
+    // bounds, mass and moments of a domain's bodies
+    struct Summary {
+
+        double xmin, xmax, ymin, ymax;
+        double mass;
+        double cx, cy;        // centre of mass
+        double qxx, qxy, qyy; // quadrupole moment about the centre of mass, traceless in 3d
+    };
+
+    void bisect(const Body_Store &bodies);  // finds the domains again, weighting bodies with their domain's cost
+    int  split(const Body_Store &bodies, const std::vector<double> &weight, std::vector<int> &index,
+               int begin, int end, int first, int count);
+    int  domain_of(double x, double y) const;
+
+    // sends each worker its share of bodies with the targets listed in each domain, and adds the accelerations it returns
+    long exchange(const Body_Store &bodies, const std::vector<std::vector<int>> &targets, double cutoff,
+                  double softening, double theta, bool single, std::vector<double> &ax, std::vector<double> &ay);
+
+    std::vector<int>                  sockets;      // coordinator's end of the socket to each worker
+    std::vector<pid_t>                workers;      // process id of each worker
+
+    std::vector<Split>                splits;       // bisection tree, root first, empty until the first bisection
+    int                               split_bodies = -1; // number of bodies when the domains were found
+    std::vector<int>                  owner;        // domain of each body in the last evaluation
+    std::vector<double>               cost;         // pairs summed in each domain in the last whole evaluation
+
+    std::vector<std::vector<int>>     members;      // bodies of each domain
+    std::vector<Summary>              summaries;    // summary of each domain's bodies
+};
+
+#endif /* DOMAINS_H */
@@ -0,0 +1,37 @@
+#include "draw_snapshot.h"
+#include <algorithm>
+
+
+void take_snapshot(const Simulation &sim, bool full_trails, long since_step, Draw_Snapshot &snapshot) {
+
+    const Body_Store &bodies = sim.bodies;
+    int n = bodies.size();
+
+    snapshot.x.assign(bodies.x.begin(), bodies.x.end());
+    snapshot.y.assign(bodies.y.begin(), bodies.y.end());
+    snapshot.m.assign(bodies.m.begin(), bodies.m.end());
+    snapshot.trail_start.resize(n+1);
+    snapshot.trail_points.clear();
+
+    // whole trails are only copied when they have to be redrawn, otherwise just the
+    // points added since the last snapshot and the point before them to join them on
+    snapshot.full_trails = full_trails;
+    snapshot.new_steps   = sim.trail_steps - since_step;
+
+    for(int i = 0; i < n; i++) {
+
+        snapshot.trail_start[i] = snapshot.trail_points.size();
+
+        int length = bodies.trails.length(bodies.trail[i]);
+        if(!full_trails) { length = std::min<long>(length, snapshot.new_steps + 1); }
+
+        for(int k = 0; k < length; k++) {
+
+            snapshot.trail_points.push_back(bodies.trails.point(bodies.trail[i], k));
+        }
+    }
+
+    snapshot.trail_start[n] = snapshot.trail_points.size();
+    snapshot.step           = sim.trail_steps;
+    snapshot.trail_bytes    = bodies.trails.bytes();
+}
@@ -0,0 +1,29 @@
+#ifndef DRAW_SNAPSHOT_H
+#define DRAW_SNAPSHOT_H
+
+#include "simulation.h"
+#include <vector>
+#include <array>
+#include <cstddef>
+
+
+// copy of the state needed to draw one step, published by the stepper thread for drawing
+struct Draw_Snapshot {
+
+    std::vector<double>                x;                   // x coordinate of each body
+    std::vector<double>                y;                   // y coordinate of each body
+    std::vector<double>                m;                   // mass of each body
+    std::vector<int>                   trail_start;         // trail of body i is trail_points[trail_start[i] .. trail_start[i+1]]
+    std::vector<std::array<double, 2>> trail_points;        // newest points of each trail, newest first - see full_trails
+    bool                               full_trails = false; // true if trail_points holds whole trails, otherwise only the
+                                                            // points added since the previous snapshot and the one before
+    long                               new_steps   = 0;     // number of times trails were stored since the previous snapshot
+    long                               step        = 0;     // value of sim.trail_steps when the snapshot was taken
+    size_t                             trail_bytes = 0;     // memory held by the trail arena
+};
+
+// fills snapshot from sim, whose previous snapshot was taken at trail step since_step - the snapshot's
+// vectors keep their capacity between uses so this doesn't allocate in steady state
+void take_snapshot(const Simulation &sim, bool full_trails, long since_step, Draw_Snapshot &snapshot);
+
+#endif /* DRAW_SNAPSHOT_H */
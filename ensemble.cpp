@@ -0,0 +1,305 @@
+#include "ensemble.h"
+#include "scenarios.h"
+#include "thread_pool.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <cmath>
+
+
+// most runs a sweep may expand to, to catch a sweep that multiplies out far beyond what was meant
+static const long max_runs = 1000000;
+
+// reads the whole of text as a T - false if it isn't one
+template<class T>
+static bool parse(const std::string &text, T &value) {
+
+    std::istringstream in(text);
+    in >> value;
+
+    return !in.fail() && (in >> std::ws).eof();
+}
+
+std::string Ensemble_Run::scene() const {
+
+    if(!scenario.empty()) { return scenario + " " + std::to_string(count) + " " + std::to_string(seed); }
+
+    return bodies_path;
+}
+
+double Ensemble_Run::cost() const {
+
+    // body-steps, times the cost of a force evaluation per body for the method
+    double n     = scenario.empty() ? 4 : count;
+    double steps = seconds * 60 * std::abs(timescale) / dt;
+
+    switch(method) {
+
+        case BARNES_HUT:    return steps * n * std::log2(n + 1);
+        case PARTICLE_MESH: return steps * (n + (double) mesh_size * mesh_size / 8);
+        case P3M:           return steps * (n * 16 + (double) mesh_size * mesh_size / 8);
+        default:            return steps * n * n;
+    }
+}
+
+bool Ensemble::apply(const std::string &name, const std::string &value, Ensemble_Run &run) {
+
+    if(name == "scenario") {
+
+        run.scenario = value;
+        return is_scenario(value);
+    }
+
+    if(name == "bodies") {
+
+        run.bodies_path = value;
+        run.scenario.clear();
+        return true;
+    }
+
+    if(name == "method") { return parse_force_method(value, run.method); }
+
+    if(name == "launch") {
+
+        // x,y,vx,vy,mass as read from the mouse in the gui
+        std::string spaced = value;
+        std::replace(spaced.begin(), spaced.end(), ',', ' ');
+
+        std::istringstream in(spaced);
+        Body &b = run.launch;
+        in >> b.pos[0] >> b.pos[1] >> b.vel[0] >> b.vel[1] >> b.mass;
+
+        run.launched = true;
+        return !in.fail() && (in >> std::ws).eof();
+    }
+
+    if(name == "count")     { return parse(value, run.count) && run.count > 0; }
+    if(name == "seed")      { return parse(value, run.seed); }
+    if(name == "mass")      { return parse(value, run.mass); }
+    if(name == "speed")     { return parse(value, run.speed); }
+    if(name == "timescale") { return parse(value, run.timescale); }
+    if(name == "seconds")   { return parse(value, run.seconds) && run.seconds >= 0; }
+    if(name == "dt")        { return parse(value, run.dt) && run.dt > 0; }
+    if(name == "theta")     { return parse(value, run.theta); }
+    if(name == "mesh")      { return parse(value, run.mesh_size) && run.mesh_size > 0; }
+    if(name == "cutoff")    { return parse(value, run.cutoff); }
+    if(name == "softening") { return parse(value, run.softening); }
+    if(name == "skin")      { return parse(value, run.skin); }
+    if(name == "single")    { return parse(value, run.single); }
+    if(name == "merge")     { return parse(value, run.merging); }
+    if(name == "fused")     { return parse(value, run.fused); }
+    if(name == "levels")    { return parse(value, run.levels) && run.levels >= 0 && run.levels <= max_timestep_level; }
+    if(name == "eta")       { return parse(value, run.eta) && run.eta > 0; }
+
+    return false;
+}
+
+bool Ensemble::load(const std::string &path) {
+
+    sweep.clear();
+    settings.clear();
+    choices.clear();
+    scenes.clear();
+
+    std::ifstream in(path);
+
+    if(!in) {
+
+        error = "couldn't open " + path;
+        return false;
+    }
+
+    // each line is a setting and the values it takes, up to any comment
+    std::string line;
+    long        total = 1;
+
+    for(int number = 1; std::getline(in, line); number++) {
+
+        std::istringstream words(line.substr(0, line.find('#')));
+        std::string        name, value;
+        std::vector<std::string> values;
+
+        if(!(words >> name)) { continue; }
+        while(words >> value) { values.push_back(value); }
+
+        Ensemble_Run check;
+
+        for(const std::string &v : values) {
+
+            if(!apply(name, v, check)) {
+
+                error = path + ":" + std::to_string(number) + ": bad value " + v + " for " + name;
+                return false;
+            }
+        }
+
+        if(values.empty()) {
+
+            error = path + ":" + std::to_string(number) + ": no values for " + name;
+            return false;
+        }
+
+        total *= values.size();
+
+        if(total > max_runs) {
+
+            error = path + " sweeps more than " + std::to_string(max_runs) + " runs";
+            return false;
+        }
+
+        sweep.emplace_back(name, values);
+    }
+
+    // count through the combinations with the last setting of the file changing fastest
+    settings.resize(total);
+    choices.resize(total);
+
+    for(long r = 0; r < total; r++) {
+
+        long rest = r;
+        choices[r].resize(sweep.size());
+
+        for(int s = sweep.size() - 1; s >= 0; s--) {
+
+            int size      = sweep[s].second.size();
+            choices[r][s] = rest % size;
+            rest         /= size;
+        }
+
+        for(size_t s = 0; s < sweep.size(); s++) { apply(sweep[s].first, sweep[s].second[choices[r][s]], settings[r]); }
+    }
+
+    // build each distinct set of starting bodies once, before any run needs it
+    for(const Ensemble_Run &run : settings) {
+
+        std::string key = run.scene();
+        if(scenes.count(key)) { continue; }
+
+        Simulation reader(1);
+
+        if(!run.scenario.empty()) { reader.bodies = make_scenario(run.scenario, run.count, run.seed); }
+
+        else if(!run.bodies_path.empty() && !reader.load(run.bodies_path)) {
+
+            error = "couldn't read bodies from " + run.bodies_path;
+            return false;
+        }
+
+        scenes[key] = reader.bodies;
+    }
+
+    return true;
+}
+
+Ensemble_Result Ensemble::run_one(const Ensemble_Run &run, Simulation &sim) const {
+
+    // clearing first marks the last run's forces as stale, then assigning reuses the storage it left
+    sim.clear();
+    sim.bodies = scenes.at(run.scene());
+
+    for(int i = 0; i < sim.bodies.size(); i++) {
+
+        sim.bodies.m[i]  *= run.mass;
+        sim.bodies.vx[i] *= run.speed;
+        sim.bodies.vy[i] *= run.speed;
+    }
+
+    if(run.launched) { sim.add(run.launch); }
+
+    sim.traillength  = 0;
+    sim.accumulator  = 0;
+    sim.dt           = run.dt;
+    sim.max_level    = run.levels;
+    sim.eta          = run.eta;
+    sim.force_method = run.method;
+    sim.theta        = run.theta;
+    sim.mesh_size    = run.mesh_size;
+    sim.cutoff       = run.cutoff;
+    sim.softening    = run.softening;
+    sim.skin         = run.skin;
+    sim.single       = run.single;
+    sim.merging      = run.merging;
+    sim.fused        = run.fused;
+
+    // there is no frame to keep up with, so every substep asked for is taken
+    sim.max_substeps = std::numeric_limits<int>::max();
+
+    Ensemble_Result result;
+    result.start_bodies = sim.bodies.size();
+    result.start_energy = sim.energy();
+
+    long merges = sim.merges;
+    long frames = std::lround(run.seconds * 60);
+    auto start  = std::chrono::steady_clock::now();
+
+    // as many frames as the gui would draw in the time, each advancing the time scale
+    for(long f = 0; f < frames; f++) { sim.advance(run.timescale); }
+
+    result.wall         = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.end_bodies   = sim.bodies.size();
+    result.merges       = sim.merges - merges;
+    result.end_energy   = sim.energy();
+    result.drift        = result.start_energy != 0 ? (result.end_energy - result.start_energy) / std::abs(result.start_energy) : 0;
+
+    return result;
+}
+
+void Ensemble::run(int threads, std::ostream &results, std::ostream *progress) {
+
+    int total = settings.size();
+    this->results.assign(total, Ensemble_Result());
+
+    // longest first, so that no long run is left to start once the others are nearly done
+    std::vector<int> order(total);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return settings[a].cost() > settings[b].cost(); });
+
+    // one task per thread, each taking the next run from the shared order until there are none left
+    Thread_Pool pool(threads);
+    std::vector<std::unique_ptr<Simulation>> sims(pool.size());
+    std::atomic<int> next(0);
+    std::mutex       progress_lock;
+    int              finished = 0;
+
+    pool.run(pool.size(), [&](int, int worker) {
+
+        if(!sims[worker]) { sims[worker].reset(new Simulation(1)); }
+
+        for(int k = next++; k < total; k = next++) {
+
+            int r = order[k];
+            this->results[r] = run_one(settings[r], *sims[worker]);
+
+            if(progress) {
+
+                std::lock_guard<std::mutex> guard(progress_lock);
+                *progress << "run " << r << " finished in " << this->results[r].wall << " s (" << ++finished
+                          << " of " << total << ")\n";
+            }
+        }
+    });
+
+    // swept settings first, quoted since a launch has commas in it
+    results << "run";
+    for(auto &setting : sweep) { results << "," << setting.first; }
+    results << ",start_bodies,end_bodies,merges,start_energy,end_energy,energy_drift,wall_s\n";
+
+    results.precision(10);
+
+    for(int r = 0; r < total; r++) {
+
+        const Ensemble_Result &result = this->results[r];
+
+        results << r;
+        for(size_t s = 0; s < sweep.size(); s++) { results << ",\"" << sweep[s].second[choices[r][s]] << "\""; }
+
+        results << "," << result.start_bodies << "," << result.end_bodies << "," << result.merges << ","
+                << result.start_energy << "," << result.end_energy << "," << result.drift << "," << result.wall << "\n";
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "simulation.h"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <map>
+
+
+// settings of one run of an ensemble - what it starts from, how the starting bodies are varied and
+// the settings of the simulation that steps them
+struct Ensemble_Run {
+
+    std::string  scenario;           // scenario to start from, or empty for bodies_path or the 4 bodies of the gui
+    std::string  bodies_path;        // text file of bodies to start from, as read by Simulation::load
+    int          count       = 1000; // number of bodies in the scenario
+    unsigned     seed        = 1;    // seed of the scenario
+    double       mass        = 1;    // factor applied to the mass of every starting body
+    double       speed       = 1;    // factor applied to the velocity of every starting body
+    bool         launched    = false; // true if launch is added to the starting bodies
+    Body         launch;             // body added as if launched with the mouse in the gui
+    double       timescale   = 1;    // simulated time advanced in each frame of 1/60 s
+    double       seconds     = 10;   // length of the run in seconds of a gui session at 60 frames per second
+    double       dt          = 1;
+    Force_Method method      = DIRECT_SUM;
+    double       theta       = 0.5;
+    int          mesh_size   = 256;
+    double       cutoff      = 2000;
+    double       softening   = 0;
+    double       skin        = 200;
+    bool         single      = false;
+    bool         merging     = true;
+    bool         fused       = false;
+    int          levels      = 8;
+    double       eta         = 0.05;
+
+    std::string  scene() const;  // identifies the starting bodies before they are varied
+    double       cost() const;   // rough relative cost of the run, for running the longest first
+};
+
+// what a run of an ensemble did
+struct Ensemble_Result {
+
+    int    start_bodies = 0;
+    int    end_bodies   = 0;
+    long   merges       = 0;
+    double start_energy = 0;
+    double end_energy   = 0;
+    double drift        = 0;     // change in energy relative to its starting size
+    double wall         = 0;     // seconds spent stepping the run
+};
+
+// runs every combination of a sweep of settings as independent simulations, several at a time. A sweep
+// is a text file with a setting on each line followed by the values it takes - every combination of
+// the values is a run, and # starts a comment:
+//
+//   scenario  galaxy
+//   count     2000
+//   seconds   20
+//   timescale 0.5 1 2 4
+//   mass      0.5 1 2
+//   launch    0,0,1.2,0,5  300,0,0,-1,2
+//
+// The settings are scenario, bodies, count, seed, mass, speed, launch (a body as x,y,vx,vy,mass),
+// timescale, seconds, dt, method, theta, mesh, cutoff, softening, skin, single, merge, fused, levels and eta.
+//
+// Each run is stepped on one thread, so its results don't depend on how many run at once. The threads
+// take the runs longest first as they become free, and each keeps one simulation whose storage is
+// reused from run to run, with every distinct set of starting bodies built once and shared
+class Ensemble {
+
+public:
+    // reads a sweep and builds its runs and their starting bodies - false with error set if it can't be used
+    bool load(const std::string &path);
+
+    // runs every run of the sweep on up to threads threads at once (0 for one per hardware thread) and
+    // writes a csv line of the swept settings and the results of each to results, in the order of the
+    // sweep - a line is written to progress as each run finishes if it is given
+    void run(int threads, std::ostream &results, std::ostream *progress = nullptr);
+
+    int runs() const { return settings.size(); }
+
+    std::vector<Ensemble_Result> results; // result of each run after run()
+    std::string                  error;   // why load last failed
+
+protected:
+    // sets the named setting of run from a value of the sweep - false if either isn't recognised
+    static bool apply(const std::string &name, const std::string &value, Ensemble_Run &run);
+
+    // steps one run from a copy of its starting bodies in sim
+    Ensemble_Result run_one(const Ensemble_Run &run, Simulation &sim) const;
+
+    std::vector<std::pair<std::string, std::vector<std::string>>> sweep;      // each setting and its values, in file order
+    std::vector<Ensemble_Run>                                     settings;   // every combination of the values
+    std::vector<std::vector<int>>                                 choices;    // which value of each setting each run takes
+    std::map<std::string, Body_Store>                             scenes;     // starting bodies, by Ensemble_Run::scene
+};
+
+#endif /* ENSEMBLE_H */
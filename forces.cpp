@@ -0,0 +1,348 @@
+#include "forces.h"
+#include <algorithm>
+#include <cmath>
+
+
+static int tiles(int n) {
+
+    return (n + force_tile - 1) / force_tile;
+}
+
+Direct_Sum::Direct_Sum() :
+    origin{0, 0} {
+
+    kernel = select_direct_kernel(policy, &name);
+}
+
+void Direct_Sum::select(const Kernel_Policy &policy) {
+
+    if(policy == this->policy) { return; }
+
+    this->policy = policy;
+    kernel       = select_direct_kernel(policy, &name);
+}
+
+Kernel_Input Direct_Sum::input(const Body_Store &bodies, double cutoff, double softening, Thread_Pool &pool) {
+
+    int n = bodies.size();
+
+    Kernel_Input in = { bodies.x.data(), bodies.y.data(), bodies.m.data(), nullptr, nullptr, nullptr, n, cutoff, softening, nullptr };
+
+    if(!policy.single || n == 0) { return in; }
+
+    // follow the centre of the bodies' extent, which is cheap to find and stays put for a bound system
+    double xmin = bodies.x[0], xmax = bodies.x[0];
+    double ymin = bodies.y[0], ymax = bodies.y[0];
+
+    for(int i = 1; i < n; i++) {
+
+        xmin = std::min(xmin, bodies.x[i]);
+        xmax = std::max(xmax, bodies.x[i]);
+        ymin = std::min(ymin, bodies.y[i]);
+        ymax = std::max(ymax, bodies.y[i]);
+    }
+
+    origin = {0.5 * (xmin + xmax), 0.5 * (ymin + ymax)};
+
+    x.resize(n);
+    y.resize(n);
+    m.resize(n);
+
+    pool.run(tiles(n), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, n);
+
+        for(int i = begin; i < end; i++) {
+
+            x[i] = bodies.x[i] - origin[0];
+            y[i] = bodies.y[i] - origin[1];
+            m[i] = bodies.m[i];
+        }
+    });
+
+    in.fx = x.data();
+    in.fy = y.data();
+    in.fm = m.data();
+
+    return in;
+}
+
+// joins the pairs each tile found - a pair is stored lowest index first whichever body found it, so
+// like the collision finder, sort them to make the order that of a search over every body
+static void gather_contacts(Direct_Sum &direct, int tiles, std::vector<std::array<int, 2>> *contacts) {
+
+    if(!contacts) { return; }
+
+    contacts->clear();
+
+    for(int t = 0; t < tiles; t++) {
+
+        contacts->insert(contacts->end(), direct.tile_contacts[t].begin(), direct.tile_contacts[t].end());
+    }
+
+    std::sort(contacts->begin(), contacts->end());
+}
+
+long direct_accelerations(const Body_Store &bodies, Direct_Sum &direct, double cutoff, double softening, Thread_Pool &pool,
+                          std::vector<double> &ax, std::vector<double> &ay, std::vector<std::array<int, 2>> *contacts) {
+
+    int n = bodies.size();
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    Kernel_Input in = direct.input(bodies, cutoff, softening, pool);
+    direct.tile_contacts.resize(tiles(n));
+
+    pool.run(tiles(n), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, n);
+
+        direct.tile_contacts[t].clear();
+        direct.kernel(in, begin, end, ax.data(), ay.data(), &direct.tile_contacts[t]);
+    });
+
+    if(direct.policy.contacts) { gather_contacts(direct, tiles(n), contacts); }
+
+    // every body against every other, a body not being paired with itself
+    return n > 0 ? (long) n * (n - 1) : 0;
+}
+
+long tree_accelerations(const Body_Store &bodies, Quadtree &tree, double theta, double cutoff, Thread_Pool &pool,
+                        std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    tree.build(bodies);
+
+    // each tile counts its own interactions
+    std::vector<long> counts(tiles(n), 0);
+
+    pool.run(tiles(n), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, n);
+
+        for(int i = begin; i < end; i++) {
+
+            std::array<double, 2> acc = tree.acceleration(i, bodies, theta, cutoff, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
+
+long mesh_accelerations(const Body_Store &bodies, Particle_Mesh &mesh, int mesh_size, bool short_range, double cutoff,
+                        Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    mesh.solve(bodies, mesh_size, short_range, cutoff, pool);
+
+    std::vector<long> counts(tiles(n), 0);
+
+    pool.run(tiles(n), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, n);
+
+        for(int i = begin; i < end; i++) {
+
+            std::array<double, 2> acc = mesh.acceleration(i, bodies, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
+
+long cell_accelerations(const Body_Store &bodies, Neighbour_List &neighbours, Direct_Sum &direct, double cutoff, double skin,
+                        double softening, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+
+    neighbours.update(bodies, cutoff, skin, pool);
+
+    if(neighbours.crowded()) { return direct_accelerations(bodies, direct, cutoff, softening, pool, ax, ay); }
+
+    ax.assign(n, 0);
+    ay.assign(n, 0);
+
+    std::vector<long> counts(tiles(n), 0);
+
+    pool.run(tiles(n), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min(begin + force_tile, n);
+
+        for(int i = begin; i < end; i++) {
+
+            std::array<double, 2> acc = neighbours.acceleration(i, bodies, softening, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
+
+long direct_accelerations(const Body_Store &bodies, const std::vector<int> &active, Direct_Sum &direct, double cutoff,
+                          double softening, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay,
+                          std::vector<std::array<int, 2>> *contacts) {
+
+    int n = bodies.size();
+    ax.resize(n);
+    ay.resize(n);
+
+    Kernel_Input in = direct.input(bodies, cutoff, softening, pool);
+    direct.tile_contacts.resize(tiles(active.size()));
+
+    // a pair of active bodies is only listed from the lower of the two
+    if(direct.policy.contacts) {
+
+        direct.rows.assign(n, false);
+        for(int i : active) { direct.rows[i] = true; }
+
+        in.rows = direct.rows.data();
+    }
+
+    // each active body is a row of its own, swept over every partner just as in a whole tile
+    pool.run(tiles(active.size()), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min<int>(begin + force_tile, active.size());
+
+        direct.tile_contacts[t].clear();
+
+        for(int k = begin; k < end; k++) {
+
+            int i = active[k];
+            ax[i] = 0;
+            ay[i] = 0;
+            direct.kernel(in, i, i+1, ax.data(), ay.data(), &direct.tile_contacts[t]);
+        }
+    });
+
+    if(direct.policy.contacts) { gather_contacts(direct, tiles(active.size()), contacts); }
+
+    return n > 0 ? (long) active.size() * (n - 1) : 0;
+}
+
+long tree_accelerations(const Body_Store &bodies, const std::vector<int> &active, Quadtree &tree, double theta, double cutoff,
+                        Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+    ax.resize(n);
+    ay.resize(n);
+
+    // every body has moved since the last build, so the tree is rebuilt even for a few active bodies
+    tree.build(bodies);
+
+    std::vector<long> counts(tiles(active.size()), 0);
+
+    pool.run(tiles(active.size()), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min<int>(begin + force_tile, active.size());
+
+        for(int k = begin; k < end; k++) {
+
+            int i = active[k];
+            std::array<double, 2> acc = tree.acceleration(i, bodies, theta, cutoff, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
+
+long mesh_accelerations(const Body_Store &bodies, const std::vector<int> &active, Particle_Mesh &mesh, int mesh_size,
+                        bool short_range, double cutoff, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay) {
+
+    int n = bodies.size();
+    ax.resize(n);
+    ay.resize(n);
+
+    // the grid is kept from the last solve over every body, whose long range field changes slowly
+    // over a block, and only the short range sum sees where the bodies are now
+    mesh.update(bodies, mesh_size, short_range, cutoff, pool);
+
+    std::vector<long> counts(tiles(active.size()), 0);
+
+    pool.run(tiles(active.size()), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min<int>(begin + force_tile, active.size());
+
+        for(int k = begin; k < end; k++) {
+
+            int i = active[k];
+            std::array<double, 2> acc = mesh.acceleration(i, bodies, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
+
+long cell_accelerations(const Body_Store &bodies, const std::vector<int> &active, Neighbour_List &neighbours, Direct_Sum &direct,
+                        double cutoff, double skin, double softening, Thread_Pool &pool, std::vector<double> &ax,
+                        std::vector<double> &ay) {
+
+    int n = bodies.size();
+
+    // lists still valid from the last whole evaluation are used, but rebuilding them for a few bodies
+    // would cost more than searching the cells for those bodies
+    neighbours.refresh(bodies, cutoff, skin);
+
+    if(neighbours.crowded()) { return direct_accelerations(bodies, active, direct, cutoff, softening, pool, ax, ay); }
+
+    ax.resize(n);
+    ay.resize(n);
+
+    std::vector<long> counts(tiles(active.size()), 0);
+
+    pool.run(tiles(active.size()), [&](int t, int) {
+
+        int begin = t * force_tile;
+        int end   = std::min<int>(begin + force_tile, active.size());
+
+        for(int k = begin; k < end; k++) {
+
+            int i = active[k];
+            std::array<double, 2> acc = neighbours.acceleration(i, bodies, softening, &counts[t]);
+            ax[i] = acc[0];
+            ay[i] = acc[1];
+        }
+    });
+
+    long interactions = 0;
+    for(long count : counts) { interactions += count; }
+
+    return interactions;
+}
@@ -0,0 +1,94 @@
+#ifndef FORCES_H
+#define FORCES_H
+
+#include "body.h"
+#include "barnes_hut.h"
+#include "particle_mesh.h"
+#include "neighbour_list.h"
+#include "direct_kernel.h"
+#include "thread_pool.h"
+#include <vector>
+#include <array>
+
+
+// number of bodies in each tile of rows handed to a thread
+const int force_tile = 128;
+
+// each tile owns its rows of ax and ay and sums their partners in a fixed order,
+// so the results are bit-identical whatever the number of threads - each function
+// returns the number of pairs of bodies, or of bodies and tree nodes, it summed
+
+// the direct sum kernel specialised for a policy, with the float copies of the bodies single precision
+// kernels read - the copies are taken relative to an origin moved to the centre of the bodies each
+// time, so the distances between neighbours keep their precision however far the bodies drift
+class Direct_Sum {
+
+public:
+    Direct_Sum();
+
+    // picks the instantiation for the cpu and policy, only looking again when the policy changes
+    void select(const Kernel_Policy &policy);
+
+    // input for the kernel over bodies, copying them to float first for a single precision policy
+    Kernel_Input input(const Body_Store &bodies, double cutoff, double softening, Thread_Pool &pool);
+
+    Direct_Kernel        kernel;     // instantiation for policy
+    Kernel_Policy        policy;     // policy kernel was picked for
+    const char          *name;       // name of the instruction set and precision of kernel
+
+    std::array<double, 2> origin;    // position the float copies are relative to
+
+    std::vector<std::vector<std::array<int, 2>>> tile_contacts; // touching pairs found by each tile with a contacts policy
+    std::vector<char>    rows;       // true for the bodies summed by the last evaluation of active bodies
+
+protected:
+    std::vector<float>   x;          // float copies of the positions, relative to origin
+    std::vector<float>   y;
+    std::vector<float>   m;          // float copies of the masses
+};
+
+// fills ax and ay with the direct sum acceleration of every body - with a contacts policy, also fills
+// contacts if set with every pair of touching bodies, sorted as the collision finder sorts them
+long direct_accelerations(const Body_Store &bodies, Direct_Sum &direct, double cutoff, double softening, Thread_Pool &pool,
+                          std::vector<double> &ax, std::vector<double> &ay,
+                          std::vector<std::array<int, 2>> *contacts = nullptr);
+
+// rebuilds tree and fills ax and ay with the Barnes-Hut acceleration of every body
+long tree_accelerations(const Body_Store &bodies, Quadtree &tree, double theta, double cutoff, Thread_Pool &pool,
+                        std::vector<double> &ax, std::vector<double> &ay);
+
+// solves mesh for the current positions of bodies and fills ax and ay with the mesh acceleration of
+// every body - mesh_size is the number of nodes along each side, and short_range adds the direct sum
+// of nearby pairs to a mesh which only carries the long range force
+long mesh_accelerations(const Body_Store &bodies, Particle_Mesh &mesh, int mesh_size, bool short_range, double cutoff,
+                        Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay);
+
+// updates neighbours for the current positions of bodies and fills ax and ay with the acceleration of
+// every body from the bodies within cutoff - the same pairs as the direct sum with that cutoff, with
+// Verlet lists kept between calls if skin > 0. Bodies too crowded for the cells to save anything are
+// handed to direct instead, which sums the same pairs faster
+long cell_accelerations(const Body_Store &bodies, Neighbour_List &neighbours, Direct_Sum &direct, double cutoff, double skin,
+                        double softening, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay);
+
+// fill ax[i] and ay[i] for only the bodies i listed in active, leaving the other rows untouched -
+// used by block timesteps, where most bodies are between steps when a few are due
+
+// with a contacts policy the pairs filled in are those with at least one active body
+long direct_accelerations(const Body_Store &bodies, const std::vector<int> &active, Direct_Sum &direct, double cutoff,
+                          double softening, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay,
+                          std::vector<std::array<int, 2>> *contacts = nullptr);
+
+long tree_accelerations(const Body_Store &bodies, const std::vector<int> &active, Quadtree &tree, double theta, double cutoff,
+                        Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay);
+
+// solving the mesh costs the same for a few active bodies as for all of them, so this interpolates from
+// the grid of the last whole evaluation, which the block steps in between take as fixed
+long mesh_accelerations(const Body_Store &bodies, const std::vector<int> &active, Particle_Mesh &mesh, int mesh_size,
+                        bool short_range, double cutoff, Thread_Pool &pool, std::vector<double> &ax, std::vector<double> &ay);
+
+// reuses the lists if they are still valid, otherwise only hashes the bodies into cells again
+long cell_accelerations(const Body_Store &bodies, const std::vector<int> &active, Neighbour_List &neighbours, Direct_Sum &direct,
+                        double cutoff, double skin, double softening, Thread_Pool &pool, std::vector<double> &ax,
+                        std::vector<double> &ay);
+
+#endif /* FORCES_H */
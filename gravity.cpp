@@ -1,14 +1,34 @@
-// Oscar Saharoy 2019
-
-#include <gtkmm/application.h>
-#include "gravity_window.cpp"
-
-int main(int argc, char *argv[]) {
-	
-	// create and run the Gtk application
-	auto app = Gtk::Application::create(argc, argv);
-
-	Gravity_Window gravity_window;
-
-	return app->run(gravity_window);
+// Oscar Saharoy 2019
+
+#include <gtkmm/application.h>
+#include "gravity_window.cpp"
+#include "benchmark.h"
+
+int main(int argc, char *argv[]) {
+
+	// gravity --benchmark [bodies] [threads] reports how force evaluation scales across threads
+	if(argc > 1 && std::string(argv[1]) == "--benchmark") {
+
+		int bodies  = argc > 2 ? std::stoi(argv[2]) : 20000;
+		int threads = argc > 3 ? std::stoi(argv[3]) : 0;
+		scaling_benchmark(bodies, threads, std::cout);
+		return 0;
+	}
+	
+	// gravity --load FILE starts from a snapshot - gtk is given no arguments so it doesn't try to open FILE itself
+	std::string snapshot;
+	if(argc > 2 && std::string(argv[1]) == "--load") {
+
+		snapshot = argv[2];
+		argc     = 1;
+	}
+
+	// create and run the Gtk application
+	auto app = Gtk::Application::create(argc, argv);
+
+	Gravity_Window gravity_window;
+
+	if(!snapshot.empty()) { gravity_window.load_scene(snapshot); }
+
+	return app->run(gravity_window);
 }
\ No newline at end of file
@@ -0,0 +1,277 @@
+// times each stage of a step and of drawing on seeded scenarios, writing one csv or json record per stage
+// so results can be compared across commits
+
+#include "simulation.h"
+#include "scenarios.h"
+#include "draw_snapshot.h"
+#include "renderer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cmath>
+
+
+struct Result {
+
+    std::string scenario;    // name of the scenario
+    int         bodies;      // number of bodies at the start of the stage
+    std::string stage;       // name of the timed stage
+    int         calls;       // number of timed calls
+    double      ms;          // mean time per call in milliseconds
+    double      ns_per_pair; // time per pair of bodies, for stages that visit pairs, otherwise 0
+    double      fps;         // calls per second, for drawing stages, otherwise 0
+};
+
+// mean time of call in milliseconds, repeated until min_seconds have been spent in it - setup
+// runs before every call and isn't timed
+static double time_calls(const std::function<void()> &setup, const std::function<void()> &call, double min_seconds, int &calls) {
+
+    double spent = 0;
+    calls = 0;
+
+    do {
+        setup();
+        auto start = std::chrono::steady_clock::now();
+        call();
+        spent += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        calls++;
+    } while(spent < min_seconds);
+
+    return spent * 1000 / calls;
+}
+
+static std::vector<int> parse_list(const std::string &text) {
+
+    std::vector<int>  values;
+    std::stringstream stream(text);
+    std::string       item;
+
+    while(std::getline(stream, item, ',')) { values.push_back(std::stod(item)); }
+
+    return values;
+}
+
+static std::vector<std::string> parse_names(const std::string &text) {
+
+    std::vector<std::string> names;
+    std::stringstream        stream(text);
+    std::string              item;
+
+    while(std::getline(stream, item, ',')) { names.push_back(item); }
+
+    return names;
+}
+
+static void usage() {
+
+    std::cerr << "usage: gravity_bench [options]\n"
+                 "  --scenarios A,B    scenarios to run (default disk,plummer,galaxy,cluster)\n"
+                 "  --sizes N,M        body counts (default 100,1000,10000,100000,1000000)\n"
+                 "  --seed S           seed for the scenarios (default 1)\n"
+                 "  --threads N        number of threads, 0 for one per hardware thread (default 0)\n"
+                 "  --max-direct N     largest count to time the O(N^2) direct sum at (default 20000)\n"
+                 "  --trail L          trail length, reduced to keep 2e7 trail points at most (default 100)\n"
+                 "  --size WxH         size of the offscreen image drawn into (default 1000x800)\n"
+                 "  --min-time S       seconds to spend timing each stage (default 0.2)\n"
+                 "  --format F         csv or json (default csv)\n"
+                 "  --out FILE         write results to FILE instead of stdout\n";
+}
+
+int main(int argc, char *argv[]) {
+
+    std::vector<std::string> scenarios  = scenario_names();
+    std::vector<int>         sizes      = {100, 1000, 10000, 100000, 1000000};
+    unsigned                 seed       = 1;
+    int                      threads    = 0;
+    int                      max_direct = 20000;
+    int                      trail      = 100;
+    int                      width      = 1000;
+    int                      height     = 800;
+    double                   min_time   = 0.2;
+    std::string              format     = "csv";
+    std::string              out_path;
+
+    for(int a = 1; a < argc; a++) {
+
+        std::string option = argv[a];
+        bool        more   = a+1 < argc;
+
+        if(     option == "--scenarios"  && more) { scenarios  = parse_names(argv[++a]); }
+        else if(option == "--sizes"      && more) { sizes      = parse_list(argv[++a]); }
+        else if(option == "--seed"       && more) { seed       = std::stoul(argv[++a]); }
+        else if(option == "--threads"    && more) { threads    = std::stoi(argv[++a]); }
+        else if(option == "--max-direct" && more) { max_direct = std::stoi(argv[++a]); }
+        else if(option == "--trail"      && more) { trail      = std::stoi(argv[++a]); }
+        else if(option == "--min-time"   && more) { min_time   = std::stod(argv[++a]); }
+        else if(option == "--format"     && more) { format     = argv[++a]; }
+        else if(option == "--out"        && more) { out_path   = argv[++a]; }
+        else if(option == "--size"       && more) { sscanf(argv[++a], "%dx%d", &width, &height); }
+        else {
+
+            usage();
+            return 1;
+        }
+    }
+
+    for(const std::string &scenario : scenarios) {
+
+        if(!is_scenario(scenario)) {
+
+            std::cerr << "unknown scenario " << scenario << " - expected one of";
+            for(const std::string &name : scenario_names()) { std::cerr << " " << name; }
+            std::cerr << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    Simulation          sim(threads);
+
+    for(const std::string &scenario : scenarios) {
+        for(int n : sizes) {
+
+            std::cerr << scenario << " " << n << "\n";
+
+            Body_Store initial = make_scenario(scenario, n, seed);
+            double     pairs   = (double) n * (n-1);
+
+            auto record = [&](const std::string &stage, double ms, int calls, bool per_pair, bool drawing) {
+
+                results.push_back( Result{ scenario, n, stage, calls, ms, per_pair ? ms * 1e6 / pairs : 0, drawing ? 1000 / ms : 0 } );
+            };
+
+            int    calls;
+            double ms;
+
+            // merging changes the bodies, so every call starts from a fresh copy without trails
+            sim.traillength = 0;
+            ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.join();}, min_time, calls );
+            record("join", ms, calls, true, false);
+
+            if(n <= max_direct) {
+
+                // float first, so the kernel named in the results is the double one used by the rest
+                sim.force_method = DIRECT_SUM;
+                sim.single       = true;
+                ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.gravity();}, min_time, calls );
+                record("gravity_direct_float", ms, calls, true, false);
+
+                sim.single = false;
+                ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.gravity();}, min_time, calls );
+                record("gravity_direct", ms, calls, true, false);
+            }
+
+            sim.force_method = BARNES_HUT;
+            ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.gravity();}, min_time, calls );
+            record("gravity_tree", ms, calls, true, false);
+
+            sim.force_method = CELL_LIST;
+            ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.gravity();}, min_time, calls );
+            record("gravity_cells", ms, calls, true, false);
+
+            sim.force_method = PARTICLE_MESH;
+            ms = time_calls( [&](){sim.bodies = initial;}, [&](){sim.gravity();}, min_time, calls );
+            record("gravity_mesh", ms, calls, true, false);
+
+            // fill the trails by drifting the bodies without forces, which is enough to give them shape
+            sim.bodies      = initial;
+            sim.traillength = std::max(2, std::min<int>(trail, 20000000 / std::max(n, 1)));
+
+            for(int s = 0; s < sim.traillength; s++) {
+
+                for(int i = 0; i < n; i++) {
+
+                    sim.bodies.x[i] += sim.bodies.vx[i];
+                    sim.bodies.y[i] += sim.bodies.vy[i];
+                }
+
+                sim.store_trails();
+            }
+
+            ms = time_calls( [](){}, [&](){sim.store_trails();}, min_time, calls );
+            record("store_trails", ms, calls, false, false);
+
+            Draw_Snapshot full, latest;
+            ms = time_calls( [](){}, [&](){take_snapshot(sim, true, sim.trail_steps, full);}, min_time, calls );
+            record("snapshot_full", ms, calls, false, false);
+
+            ms = time_calls( [](){}, [&](){take_snapshot(sim, false, sim.trail_steps - 1, latest);}, min_time, calls );
+            record("snapshot_step", ms, calls, false, false);
+
+            // view fitting the bodies into the image
+            double extent = 1;
+            for(int i = 0; i < n; i++) { extent = std::max(extent, std::max(std::abs(initial.x[i]), std::abs(initial.y[i]))); }
+
+            double              zoom   = 0.5 * std::min(width, height) / extent;
+            std::vector<double> centre = {width / 2.0, height / 2.0};
+
+            auto surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+            auto cr      = Cairo::Context::create(surface);
+            Renderer renderer(threads);
+
+            ms = time_calls( [](){}, [&](){renderer.draw_trails(cr, width, height, full, zoom, centre, sim.traillength);}, min_time, calls );
+            record("draw_trails_full", ms, calls, false, true);
+
+            // a snapshot is only appended to the cache once, so each call gets a step of its own
+            ms = time_calls( [&](){latest.step++;}, [&](){renderer.draw_trails(cr, width, height, latest, zoom, centre, sim.traillength);}, min_time, calls );
+            record("draw_trails_step", ms, calls, false, true);
+
+            // every body as a circle, then every body splatted
+            renderer.density_bodies = 0;
+            ms = time_calls( [](){}, [&](){renderer.draw_bodies(cr, width, height, latest, zoom, centre);}, min_time, calls );
+            record("draw_bodies", ms, calls, false, true);
+
+            renderer.density_bodies = 1;
+            ms = time_calls( [](){}, [&](){renderer.draw_bodies(cr, width, height, latest, zoom, centre);}, min_time, calls );
+            record("draw_density", ms, calls, false, true);
+
+            // a whole frame as the gui draws it between steps, splatting from its default body count
+            renderer.density_bodies = Renderer::default_density_bodies;
+            ms = time_calls( [&](){latest.step++;}, [&](){
+
+                cr -> set_source_rgb(0, 0, 0);
+                cr -> paint();
+                renderer.draw_trails(cr, width, height, latest, zoom, centre, sim.traillength);
+                renderer.draw_bodies(cr, width, height, latest, zoom, centre);
+                surface -> flush();
+            }, min_time, calls );
+            record("draw_frame", ms, calls, false, true);
+        }
+    }
+
+    std::ofstream file;
+    if(!out_path.empty()) { file.open(out_path); }
+    std::ostream &out = out_path.empty() ? std::cout : file;
+
+    if(format == "json") {
+
+        out << "[\n";
+
+        for(size_t r = 0; r < results.size(); r++) {
+
+            const Result &res = results[r];
+            out << "  {\"scenario\": \"" << res.scenario << "\", \"bodies\": " << res.bodies << ", \"stage\": \"" << res.stage
+                << "\", \"calls\": " << res.calls << ", \"ms\": " << res.ms << ", \"ns_per_pair\": " << res.ns_per_pair
+                << ", \"fps\": " << res.fps << ", \"kernel\": \"" << sim.kernel_name << "\"}" << (r+1 < results.size() ? ",\n" : "\n");
+        }
+
+        out << "]\n";
+    }
+    else {
+
+        out << "scenario,bodies,stage,calls,ms,ns_per_pair,fps,kernel\n";
+
+        for(const Result &res : results) {
+
+            out << res.scenario << "," << res.bodies << "," << res.stage << "," << res.calls << "," << res.ms << ","
+                << res.ns_per_pair << "," << res.fps << "," << sim.kernel_name << "\n";
+        }
+    }
+
+    return 0;
+}
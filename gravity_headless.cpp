@@ -0,0 +1,361 @@
+// runs the simulation without a display - for batch runs on machines without gtk
+
+#include "simulation.h"
+#include "benchmark.h"
+#include "scenarios.h"
+#include "snapshot_file.h"
+#include "trajectory.h"
+#include "ensemble.h"
+#include "domains.h"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <cmath>
+#include <memory>
+
+
+static void usage() {
+
+    std::cerr << "usage: gravity_headless [options]\n"
+                 "  --bodies FILE      initial bodies, one \"x y vx vy mass\" line each (default: the 4 bodies of the gui)\n"
+                 "  --restore FILE     start from a binary snapshot written by --save or the gui\n"
+                 "  --save FILE        write a binary snapshot of the final state\n"
+                 "  --record FILE      stream the position of every body at every step to a trajectory file\n"
+                 "  --quantum Q        record positions rounded to Q as compressed deltas (default 0, exact)\n"
+                 "  --replay FILE      read a recorded trajectory back as fast as possible instead of simulating\n"
+                 "  --scenario NAME    generate the initial bodies instead - disk, plummer, galaxy or cluster\n"
+                 "  --count N          number of bodies in the scenario (default 1000)\n"
+                 "  --seed S           seed of the scenario (default 1)\n"
+                 "  --steps N          number of steps to simulate (default 1000)\n"
+                 "  --threads N        number of threads, 0 for one per hardware thread (default 0)\n"
+                 "  --processes P      split the bodies into P domains whose forces are found by worker processes\n"
+                 "  --method M         direct, tree, mesh, p3m or cells (default direct)\n"
+                 "  --theta T          opening angle of the Barnes-Hut tree (default 0.5)\n"
+                 "  --single           direct sum in float relative to an origin which follows the bodies\n"
+                 "  --cutoff D         ignore pairs further apart than D, 0 for no cutoff (default 2000)\n"
+                 "  --softening E      soften the direct sum over a length E (default 0)\n"
+                 "  --skin S           margin of the Verlet lists of the cell list method, 0 for none (default 200)\n"
+                 "  --no-merge         let bodies pass through each other instead of joining\n"
+                 "  --fused            fuse the stages of each tick, finding collisions in the direct sum\n"
+                 "  --mesh G           nodes along each side of the particle mesh, a power of 2 (default 256)\n"
+                 "  --dt T             simulated time advanced by each step (default 1)\n"
+                 "  --trail L          length of trails stored behind bodies (default 0)\n"
+                 "  --levels L         deepest timestep level, steps as short as dt/2^L (default 8, 0 for one step size)\n"
+                 "  --eta E            accuracy of the timestep criteria (default 0.05)\n"
+                 "  --profile FILE     time each stage of every step, print percentiles and write the samples as csv\n"
+                 "  --energy           report the drift in total energy over the run\n"
+                 "  --quiet            don't print the final bodies\n"
+                 "  --benchmark [N]    report how force evaluation of N bodies scales across threads\n"
+                 "  --sweep FILE       run every combination of the settings in FILE as separate simulations, --threads at once\n"
+                 "  --results FILE     write the settings and results of each run of the sweep as csv (default: stdout)\n";
+}
+
+int main(int argc, char *argv[]) {
+
+    std::string  bodies_path;
+    std::string  scenario;
+    std::string  restore_path;
+    std::string  save_path;
+    std::string  record_path;
+    std::string  replay_path;
+    std::string  profile_path;
+    std::string  sweep_path;
+    std::string  results_path;
+    double       quantum     = 0;
+    int          count       = 1000;
+    unsigned     seed        = 1;
+    long         steps       = 1000;
+    int          threads     = 0;
+    int          processes   = 0;
+    bool         quiet       = false;
+    Force_Method method      = DIRECT_SUM;
+    double       theta       = 0.5;
+    int          mesh_size   = 256;
+    double       cutoff      = 2000;
+    double       softening   = 0;
+    double       skin        = 200;
+    bool         single      = false;
+    bool         merging     = true;
+    bool         fused       = false;
+    double       dt          = 1.0;
+    bool         energy      = false;
+    int          levels      = 8;
+    double       eta         = 0.05;
+    int          traillength = 0;
+
+    for(int a = 1; a < argc; a++) {
+
+        std::string option = argv[a];
+        bool        more   = a+1 < argc;
+
+        if(     option == "--bodies"    && more) { bodies_path = argv[++a]; }
+        else if(option == "--restore"   && more) { restore_path = argv[++a]; }
+        else if(option == "--save"      && more) { save_path   = argv[++a]; }
+        else if(option == "--record"    && more) { record_path = argv[++a]; }
+        else if(option == "--quantum"   && more) { quantum     = std::stod(argv[++a]); }
+        else if(option == "--replay"    && more) { replay_path = argv[++a]; }
+        else if(option == "--profile"   && more) { profile_path = argv[++a]; }
+        else if(option == "--sweep"     && more) { sweep_path  = argv[++a]; }
+        else if(option == "--results"   && more) { results_path = argv[++a]; }
+        else if(option == "--scenario"  && more) {
+
+            scenario = argv[++a];
+
+            if(!is_scenario(scenario)) {
+
+                std::cerr << "unknown scenario " << scenario << " - expected one of";
+                for(const std::string &name : scenario_names()) { std::cerr << " " << name; }
+                std::cerr << "\n";
+                return 1;
+            }
+        }
+        else if(option == "--count"     && more) { count       = std::stod(argv[++a]); }
+        else if(option == "--seed"      && more) { seed        = std::stoul(argv[++a]); }
+        else if(option == "--steps"     && more) { steps       = std::stol(argv[++a]); }
+        else if(option == "--threads"   && more) { threads     = std::stoi(argv[++a]); }
+        else if(option == "--processes" && more) { processes   = std::stoi(argv[++a]); }
+        else if(option == "--theta"     && more) { theta       = std::stod(argv[++a]); }
+        else if(option == "--dt"        && more) { dt          = std::stod(argv[++a]); }
+        else if(option == "--trail"     && more) { traillength = std::stoi(argv[++a]); }
+        else if(option == "--method"    && more) { if(!parse_force_method(argv[++a], method)) { usage(); return 1; } }
+        else if(option == "--mesh"      && more) { mesh_size   = std::stoi(argv[++a]); }
+        else if(option == "--cutoff"    && more) { cutoff      = std::stod(argv[++a]); }
+        else if(option == "--softening" && more) { softening   = std::stod(argv[++a]); }
+        else if(option == "--skin"      && more) { skin        = std::stod(argv[++a]); }
+        else if(option == "--single")            { single = true; }
+        else if(option == "--no-merge")          { merging = false; }
+        else if(option == "--fused")             { fused = true; }
+        else if(option == "--levels"    && more) {
+
+            levels = std::stoi(argv[++a]);
+
+            if(levels < 0 || levels > max_timestep_level) {
+
+                std::cerr << "--levels must be from 0 to " << max_timestep_level << "\n";
+                return 1;
+            }
+        }
+        else if(option == "--eta"       && more) { eta         = std::stod(argv[++a]); }
+        else if(option == "--energy")            { energy = true; }
+        else if(option == "--quiet")             { quiet = true; }
+        else if(option == "--benchmark") {
+
+            int bodies = (more && argv[a+1][0] != '-') ? std::stoi(argv[++a]) : 20000;
+            scaling_benchmark(bodies, threads, std::cout);
+            return 0;
+        }
+        else {
+
+            usage();
+            return 1;
+        }
+    }
+
+    // an ensemble runs its own simulations, one thread each
+    if(!sweep_path.empty()) {
+
+        Ensemble ensemble;
+
+        if(!ensemble.load(sweep_path)) {
+
+            std::cerr << ensemble.error << "\n";
+            return 1;
+        }
+
+        std::ofstream file;
+        if(!results_path.empty()) { file.open(results_path); }
+        std::ostream &out = results_path.empty() ? std::cout : file;
+
+        auto start = std::chrono::steady_clock::now();
+        ensemble.run(threads, out, quiet ? nullptr : &std::cerr);
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double busy    = 0;
+        for(const Ensemble_Result &result : ensemble.results) { busy += result.wall; }
+
+        std::cerr << ensemble.runs() << " runs in " << elapsed << " s (" << busy << " s of stepping)\n";
+
+        if(!out) {
+
+            std::cerr << "couldn't write the results to " << results_path << "\n";
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // the workers are forked before any thread is started, so each is a copy of a single threaded process
+    std::unique_ptr<Domain_Decomposition> domains;
+
+    if(processes > 0) {
+
+        domains.reset(new Domain_Decomposition(processes));
+
+        if(!domains->error.empty()) {
+
+            std::cerr << domains->error << "\n";
+            return 1;
+        }
+    }
+
+    Simulation sim(threads);
+    sim.domains = domains.get();
+
+    // replaying only decodes frames, so it shows how much a rerun saves over simulating again
+    if(!replay_path.empty()) {
+
+        Trajectory_Reader reader;
+        Trajectory_Frame  frame;
+
+        if(!reader.open(replay_path)) {
+
+            std::cerr << reader.error << "\n";
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        for(long f = 0; f < reader.frames(); f++) {
+
+            if(!reader.read(f, frame)) { std::cerr << reader.error << "\n"; return 1; }
+            show_frame(frame, sim);
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cerr << "replayed " << reader.frames() << " frames in " << elapsed << " s ("
+                  << reader.frames() / elapsed << " frames/s)\n";
+
+        if(!quiet) { sim.print(std::cout); }
+
+        return 0;
+    }
+
+    sim.traillength  = traillength;
+    sim.dt           = dt;
+    sim.max_level    = levels;
+    sim.eta          = eta;
+    sim.force_method = method;
+    sim.theta        = theta;
+    sim.mesh_size    = mesh_size;
+    sim.cutoff       = cutoff;
+    sim.softening    = softening;
+    sim.skin         = skin;
+    sim.single       = single;
+    sim.merging      = merging;
+    sim.fused        = fused;
+
+    if(!bodies_path.empty() && !sim.load(bodies_path)) {
+
+        std::cerr << "couldn't read bodies from " << bodies_path << "\n";
+        return 1;
+    }
+
+    if(!scenario.empty()) { sim.bodies = make_scenario(scenario, count, seed); }
+
+    // a snapshot brings its own settings, so options given with it are overridden
+    if(!restore_path.empty()) {
+
+        auto          restore_start = std::chrono::steady_clock::now();
+        Snapshot_File file;
+        Snapshot_View view;
+
+        if(!file.open(restore_path)) {
+
+            std::cerr << file.error << "\n";
+            return 1;
+        }
+
+        file.restore(sim, view);
+
+        std::cerr << "restored " << sim.bodies.size() << " bodies in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - restore_start).count() << " ms\n";
+    }
+
+    Profiler profiler;
+
+    if(!profile_path.empty()) {
+
+        profiler.enabled = true;
+        sim.profiler     = &profiler;
+    }
+
+    Trajectory_Recorder recorder;
+
+    if(!record_path.empty() && !recorder.open(record_path, quantum)) {
+
+        std::cerr << "couldn't write a trajectory to " << record_path << "\n";
+        return 1;
+    }
+
+    // advance as fast as possible, counting every body in every step - there are none to count if
+    // there are no steps or no bodies, and the rates per body-step are then shown as 0
+    long   start_bodies = sim.bodies.size();
+    double start_energy = energy ? sim.energy() : 0;
+    double body_steps   = 0;
+    auto   start        = std::chrono::steady_clock::now();
+
+    for(long s = 0; s < steps; s++) {
+
+        body_steps += sim.bodies.size();
+        sim.step();
+        recorder.record(sim);
+    }
+
+    recorder.close();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << steps << " steps of " << start_bodies << " bodies (" << sim.bodies.size() << " left, "
+              << sim.merges << " merged) in " << elapsed << " s using the " << sim.kernel_name << " kernel\n"
+              << "throughput: " << body_steps / elapsed << " body-steps/s, "
+              << (body_steps > 0 ? sim.evaluations / body_steps : 0) << " force evaluations per body-step\n";
+
+    if(domains) { std::cerr << processes << " worker processes, domains found " << domains->bisections << " times\n"; }
+
+    if(recorder.frames > 0) {
+
+        std::cerr << "recorded " << recorder.frames << " frames in " << recorder.bytes << " bytes ("
+                  << (body_steps > 0 ? recorder.bytes / body_steps : 0) << " bytes/body-step)\n";
+    }
+
+    if(!profile_path.empty()) {
+
+        for(int s = 0; s < PROFILE_SERIES_COUNT; s++) {
+
+            Profiler::Summary summary = profiler.summary((Profile_Series) s);
+            if(summary.samples == 0) { continue; }
+
+            std::cerr << profile_names[s] << (s < profile_first_counter ? " ms" : "") << ": p50 " << summary.p50
+                      << " p99 " << summary.p99 << " (" << summary.samples << " samples)\n";
+        }
+
+        std::ofstream out(profile_path);
+        profiler.write_csv(out);
+
+        if(!out) {
+
+            std::cerr << "couldn't write the profile to " << profile_path << "\n";
+            return 1;
+        }
+    }
+
+    // with the leapfrog this should stay bounded rather than growing with the number of steps
+    if(energy) {
+
+        double end_energy = sim.energy();
+        std::cerr << "energy: " << start_energy << " -> " << end_energy << " (relative drift "
+                  << (end_energy - start_energy) / std::abs(start_energy) << ")\n";
+    }
+
+    if(!save_path.empty() && !save_snapshot(save_path, sim, Snapshot_View())) {
+
+        std::cerr << "couldn't write a snapshot to " << save_path << "\n";
+        return 1;
+    }
+
+    if(!quiet) { sim.print(std::cout); }
+
+    return 0;
+}
@@ -1,461 +1,1117 @@
-#include "gravity_window.h"
-#include <glibmm/main.h>
-#include <cairomm/context.h>
-#include <gtkmm/cssprovider.h>
-#include <iostream>
-#include <algorithm>
-#include <string>
-
-#define _USE_MATH_DEFINES
-#include <cmath>
-
-Gravity_Window::Gravity_Window() :
-    side_box(Gtk::ORIENTATION_VERTICAL, 0),
-
-    title(       "Gravity"      ),
-    reset(       "Reset"        ),
-    clear(       "Clear"        ),
-    pause(       "Pause"        ),
-    traillabel(  "Trail Length" ),
-    trailvalue(  "360"          ),
-    framelabel(  "Framerate"    ),
-    framevalue(  "60.0"         ),
-    timelabel(   "Time Scale"   ),
-    timevalue(   "1.00"         ),
-
-    instructions("Move around by dragging,\nzoom with scroll wheel;\nto add new bodies right\nclick and hold, then drag."),
-
-    framerate(Gtk::ORIENTATION_HORIZONTAL),
-    timescale(Gtk::ORIENTATION_HORIZONTAL) {
-
-    // set window border and title
-    set_border_width(10);
-    set_title("Gravity");
-    set_default_size(1000, 800);
-
-    // place main_box in window and side_box in main_box
-    add(main_box);
-    side_box.set_margin_left(15);
-    main_box.pack_start(side_box, Gtk::PACK_SHRINK, 0);
-
-    /* add widgets to boxes */
-
-    // setup title label
-    title.set_markup("<span font_weight=\"bold\" font_size=\"larger\">Gravity</span>");
-    title.set_width_chars(20);
-    side_box.pack_start(title, Gtk::PACK_SHRINK, 0);
-
-    // setup reset button
-    reset.set_margin_top(15);
-    side_box.pack_start(reset, Gtk::PACK_SHRINK, 0);
-    reset.signal_clicked().connect( [this](){reset_sim();} );
-
-    // setup clear button
-    clear.set_margin_top(5);
-    side_box.pack_start(clear, Gtk::PACK_SHRINK, 0);
-    clear.signal_clicked().connect( [this](){gravity_draw.clear();} );
-
-    // setup pause button
-    pause.set_margin_top(5);
-    side_box.pack_start(pause, Gtk::PACK_SHRINK, 0);
-    pause.signal_clicked().connect( [this](){toggle_pause();} );
-
-    // setup trail scale labels
-    trail_box.set_margin_top(15);
-    side_box.pack_start(trail_box,    Gtk::PACK_SHRINK, 0);
-    trail_box.pack_start(traillabel,  Gtk::PACK_SHRINK, 0);
-    trail_box.pack_start(trailspacer, Gtk::PACK_EXPAND_WIDGET, 0);
-    trail_box.pack_start(trailvalue,  Gtk::PACK_SHRINK, 0);
-    
-    // setup trail scale
-    side_box.pack_start(traillength, Gtk::PACK_SHRINK, 0);
-    traillength_adjust_ptr = Gtk::Adjustment::create(360.0, 0.0, 1001.0, 1.0, 1.0, 1.0);
-    traillength.set_adjustment(traillength_adjust_ptr);
-    traillength_adjust_ptr->signal_value_changed().connect( [this](){traillength_changed();} );
-    traillength.set_draw_value(false);
-
-    // setup framerate scale labels
-    side_box.pack_start(frame_box,    Gtk::PACK_SHRINK, 0);
-    frame_box.pack_start(framelabel,  Gtk::PACK_SHRINK, 0);
-    frame_box.pack_start(framespacer, Gtk::PACK_EXPAND_WIDGET, 0);
-    frame_box.pack_start(framevalue,  Gtk::PACK_SHRINK, 0);
-    
-    // setup framerate scale
-    side_box.pack_start(framerate, Gtk::PACK_SHRINK, 0);
-    framerate_adjust_ptr = Gtk::Adjustment::create(60.0, 5.0, 145.0, 0.1, 1.0, 1.0);
-    framerate.set_adjustment(framerate_adjust_ptr);
-    framerate_adjust_ptr->signal_value_changed().connect( [this](){framerate_changed();} );
-    framerate.set_draw_value(false);
-
-    // setup time scale labels
-    side_box.pack_start(time_box,   Gtk::PACK_SHRINK, 0);
-    time_box.pack_start(timelabel,  Gtk::PACK_SHRINK, 0);
-    time_box.pack_start(timespacer, Gtk::PACK_EXPAND_WIDGET, 0);
-    time_box.pack_start(timevalue,  Gtk::PACK_SHRINK, 0);
-
-    // setup time scale
-    side_box.pack_start(timescale, Gtk::PACK_SHRINK, 0);
-    timescale_adjust_ptr = Gtk::Adjustment::create(1.0, -1.0, 11.0, 0.1, 1.0, 1.0);
-    timescale.set_adjustment(timescale_adjust_ptr);
-    timescale_adjust_ptr->signal_value_changed().connect( [this](){timescale_changed();} );
-    timescale.set_draw_value(false);
-
-    // setup instructions label
-    side_box.pack_start(instructions, Gtk::PACK_SHRINK, 0);
-
-    // setup gravity_draw pane
-    gravity_draw.set_margin_left(25);
-    gravity_draw.set_hexpand(true);
-    gravity_draw.set_vexpand(true);
-    main_box.pack_start(gravity_draw);
-
-
-    show_all_children();
-}
-
-void Gravity_Window::reset_sim() {
-
-    // resets slider values back to intial and then calls method to reset members of gravity_draw
-    traillength_adjust_ptr->set_value(360.0);
-    framerate_adjust_ptr->set_value(60.0);
-    timescale_adjust_ptr->set_value(1.0);
-    gravity_draw.reset();
-}
-
-void Gravity_Window::toggle_pause() {
-
-    // toggle the value of the pause variable and the text on the button
-    gravity_draw.paused = !gravity_draw.paused;
-    pause.set_label(gravity_draw.paused ? "Unpause" : "Pause");
-}
-
-void Gravity_Window::traillength_changed() {
-    
-    // gets the value from the adjustment pointer and sets the traillength label to the new value
-    gravity_draw.traillength = traillength_adjust_ptr->get_value();
-    std::string text = std::to_string(gravity_draw.traillength);
-    trailvalue.set_label(text);
-}
-
-void Gravity_Window::framerate_changed() {
-
-    // gets the value from the adjustment pointer, calls the method of gravity_draw to respond to the
-    // change and sets the framevalue label to the first 4 characters of the new value
-    gravity_draw.framerate = framerate_adjust_ptr->get_value();
-    gravity_draw.framerate_changed();
-    std::string text = std::to_string(gravity_draw.framerate).substr(0, 4);
-    framevalue.set_label(text);
-}
-
-void Gravity_Window::timescale_changed() {
-
-    // gets the value from the adjustment pointer and sets the framevalue label to
-    // the first 4 characters of the new value
-    gravity_draw.timescale = timescale_adjust_ptr->get_value();
-    std::string text = std::to_string(gravity_draw.timescale).substr(0, 4);
-    timevalue.set_label(text);
-}
-
-
-
-Gravity_Draw::Gravity_Draw() :
-    paused(false),
-    mouse_info{0, 0, 0, 0, false, 0},
-    background{0, 0, 0},
-    framerate(60.0),
-    timescale(1.0) {
-
-    // set members to intial values
-    reset();
-
-    // triggers the on_timeout method each frame
-    timeout_connection = Glib::signal_timeout().connect( sigc::mem_fun(*this, &Gravity_Draw::on_timeout), 1000.0/framerate );
-
-    // lets the widget detect the events it needs to
-    set_events(Gdk::SCROLL_MASK | Gdk::POINTER_MOTION_MASK | Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK);    
-}
-
-void Gravity_Draw::reset() {
-
-    // set variables to initial values
-    bodies      = { Body{ {  0,   0}, { 1.2,    0}, 1.0, {} },
-                    Body{ {  0, 100}, {   0, -1.2}, 1.0, {} },
-                    Body{ {100,   0}, {   0,  1.2}, 1.0, {} },
-                    Body{ {100, 100}, {-1.2,    0}, 1.0, {} } };
-                    
-    zoom        = 1.0;
-    centre      = {350, 320};
-    traillength = 360;
-}
-
-void Gravity_Draw::clear() {
-
-    // remove all bodies
-    bodies = {};
-
-    // set background to white causing a flash upon clearing bodies
-    background = {1.0, 1.0, 1.0};
-}
-
-bool Gravity_Draw::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
-
-    // reduce value of background toward black to provide flash after clearing bodies
-    if( background[0] != 0.0) {
-
-        background[0] -= 0.05;
-        background[1] -= 0.05;
-        background[2] -= 0.05;
-    }
-
-    // paint background
-    cr -> set_source_rgb(background[0], background[1], background[2]);
-    cr -> paint();
-
-    // set line cap style
-    cr -> set_line_cap(Cairo::LINE_CAP_ROUND);
-
-    // for each body, draw the trail
-    for(Body &body : bodies) {
-
-        cr -> set_source_rgb(1.0, 1.0, 1.0);
-        cr -> set_line_width(1*zoom);
-        cr -> move_to(centre[0] + body.trail[0][0]*zoom, centre[1] + body.trail[0][1]*zoom);
-
-        cr -> set_source_rgba(1.0, 1.0, 1.0, 0.65);
-        int trail_actual_length = body.trail.size();
-
-        for(int j = 0; j<trail_actual_length-1; j++) {
-
-            cr -> line_to(centre[0] + body.trail[j+1][0]*zoom, centre[1] + body.trail[j+1][1]*zoom);
-        }
-
-        cr -> stroke();
-    }
-
-    // for each body, draw the body
-    for(Body &body : bodies) {
-
-        cr -> set_line_width(5*zoom);
-        cr -> arc(centre[0] + body.pos[0]*zoom, centre[1] + body.pos[1]*zoom, 10*body.mass*zoom, 0, M_PI*2);
-        cr -> set_source_rgb(0.0, 0.0, 0.0);
-        cr -> fill_preserve();
-        cr -> set_source_rgb(0.4, 0.8, 0.1);
-        cr -> stroke();
-    }
-
-    // if the mouse is right clicked...
-    if(mouse_info.clicked) {
-
-        // if the mouse is still at the place it was clicked then increment click time
-        if(mouse_info.click_x == mouse_info.x & mouse_info.click_y == mouse_info.y) {
-
-            mouse_info.click_time += 0.03;
-        }
-
-        // draw a blue line from where the click happened to the current mouse position
-        cr -> set_source_rgb(0.1, 0.6, 0.8);
-        cr -> move_to(mouse_info.click_x, mouse_info.click_y);
-        cr -> line_to(mouse_info.x, mouse_info.y);
-        cr -> stroke();
-
-        // draw a blue circle where the click happened 
-        cr -> arc(mouse_info.click_x, mouse_info.click_y, 10*mouse_info.click_time*zoom, 0, M_PI*2);
-        cr -> set_source_rgb(0.0, 0.0, 0.0);
-        cr -> fill_preserve();
-        cr -> set_source_rgb(0.1, 0.6, 0.8);
-        cr -> stroke();
-    }
-
-    return true;
-}
-
-bool Gravity_Draw::on_timeout() {
-
-    // advance simulation if it isnt paused
-    if(!paused){
-
-        store_trails();
-        join();
-        gravity();
-    }
-
-    // schedule drawing area to be redrawn
-    queue_draw();
-
-    return true;
-}
-
-bool Gravity_Draw::on_scroll_event(GdkEventScroll * scroll_event) {
-
-    // store previous zoom level for arithmatic later
-    prev_zoom  = zoom;
-
-    // zoom in or out depending on scroll_event->direction - 0 when scrolling down and 1 when scrolling up
-    zoom      *=  scroll_event->direction ? 0.95 : 1.05;
-
-    // move centre of coordinate system such that the zoom is centred on the mouse position
-    centre[0] += (scroll_event->x - centre[0])/zoom * (prev_zoom-zoom);
-    centre[1] += (scroll_event->y - centre[1])/zoom * (prev_zoom-zoom);
-
-    return true;
-}
-
-bool Gravity_Draw::on_button_press_event(GdkEventButton * button_event) {
-
-    // if mouse button 3 is pressed, store mouse info
-    if(button_event->button == 3) {
-
-        mouse_info.click_x = button_event->x;
-        mouse_info.click_y = button_event->y;
-        mouse_info.clicked = true;
-    }
-
-    return true;
-}
-
-bool Gravity_Draw::on_button_release_event(GdkEventButton * button_event) {
-
-    // is mouse button 3 is released...
-    if(button_event->button == 3) {
-    
-        // calculate coordinates of new body from screen coordinates of mouse click
-        double nx = (mouse_info.click_x - centre[0])/zoom;
-        double ny = (mouse_info.click_y - centre[1])/zoom;
-
-        // calculate velocity of new body from the drag of the mouse while right clicked
-        double dx = (mouse_info.x - mouse_info.click_x)/50;
-        double dy = (mouse_info.y - mouse_info.click_y)/50;
-
-        // add new body by adding new element to vectors storing body info
-        bodies.push_back( Body{ {nx,ny}, {dx, dy}, mouse_info.click_time, {} } );
-
-        // store mouse info
-        mouse_info.clicked    = false;
-        mouse_info.click_time = 0.0;
-    }
-
-    return true;
-}
-
-bool Gravity_Draw::on_motion_notify_event(GdkEventMotion * motion_event) {
-
-    // if mouse button 1 is pressed...
-    if(motion_event->state & GDK_BUTTON1_MASK) {
-
-        // calculate motion of mouse in x and y
-        double dx  = motion_event->x - mouse_info.x;
-        double dy  = motion_event->y - mouse_info.y;
-    
-        // shift centre of coordinate system by this amount to drag simulation around
-        centre[0] += dx;
-        centre[1] += dy;
-    }
-
-    // store new mouse position
-    mouse_info.x = motion_event->x;
-    mouse_info.y = motion_event->y;
-
-    return true;
-}
-
-void Gravity_Draw::framerate_changed() {
-
-    // change the timing of the on_timout event to match the new framerate
-    timeout_connection.disconnect();
-    timeout_connection = Glib::signal_timeout().connect( sigc::mem_fun(*this, &Gravity_Draw::on_timeout), 1000.0/framerate );
-}
-
-void Gravity_Draw::store_trails() {
-
-    // for each body...
-    for(Body &body : bodies) {
-
-        // push current position onto the front of the deque
-        body.trail.push_front(body.pos);
-
-        // if the length of the deque is greater than the desired trail length, remove an item from the end of the deque
-        // using a loop to remove up to 3 items
-        for(int j = 0; j<3; j++) {
-            if(body.trail.size() > traillength) {
-    
-                body.trail.pop_back();
-            }
-        }
-    }
-}
-
-void Gravity_Draw::gravity() {
-
-    // for each combination of bodies...
-    for(int i1 = 0; i1 < bodies.size(); i1++) {
-
-        Body &body1       = bodies[i1];
-        
-        for(int i2 = i1+1; i2 < bodies.size(); i2++) {
-
-            Body &body2   = bodies[i2];
-
-            double dx     = body1.pos[0]-body2.pos[0]; // x distance
-            double dy     = body1.pos[1]-body2.pos[1]; // y distance
-            double d      = sqrt( dx*dx + dy*dy );     // total distance
-
-            // if distance > 2000, skip calculations
-            if(d > 2000) { continue; } 
-
-            // force on each body
-            double f      = 100 * body1.mass*body2.mass / (d*d); 
-         
-            double s      = dy/d; // sine of angle
-            double c      = dx/d; // cosine of angle
-          
-            body1.vel[0] -= f*c/body1.mass * 60/framerate * timescale; // applying accelaration to bodies 
-            body1.vel[1] -= f*s/body1.mass * 60/framerate * timescale;    
-            body2.vel[0] += f*c/body2.mass * 60/framerate * timescale;
-            body2.vel[1] += f*s/body2.mass * 60/framerate * timescale;
-        }
-            
-        body1.pos[0] += body1.vel[0] * 60/framerate * timescale; // move body by velocity
-        body1.pos[1] += body1.vel[1] * 60/framerate * timescale;
-    }
-}
-
-void Gravity_Draw::join() {
-
-    for(int i1 = 0; i1 < bodies.size(); i1++) {
-        for(int i2 = i1+1; i2 < bodies.size(); i2++) {
-
-            Body &body1   = bodies[i1];
-            Body &body2   = bodies[i2];
-
-            double dx     = body1.pos[0]-body2.pos[0]; // x distance
-            double dy     = body1.pos[1]-body2.pos[1]; // y distance
-            double d      = sqrt( dx*dx + dy*dy );     // total distance
-
-            // if the distance between the centres is smaller than the sum of the radii of the bodies they collide
-            if(d < 10*(body1.mass + body2.mass)) {
-
-                // calculate x and y momentum
-                double px = body1.mass*body1.vel[0] + body2.mass*body2.vel[0];
-                double py = body1.mass*body1.vel[1] + body2.mass*body2.vel[1];
-            
-                // total mass
-                double m  = body1.mass + body2.mass;
-            
-                // conservation of momentum
-                double vx = px/m;
-                double vy = py/m;
-
-                // big is the larger body and s is the smaller body's index in bodies vector - larger absorbs smaller
-                Body &big = (body1.mass > body2.mass) ? body1 : body2;
-                int  s    = (body1.mass < body2.mass) ? i1    : i2;
-            
-                // set new values in mass and vel vectors - bugged
-                big.mass  = m;
-                big.vel   = {vx, vy};
-            
-                // erase values associated with absorbed body
-                bodies.erase(bodies.begin() + s);
-            }
-        }
-    }
-}
\ No newline at end of file
+#include "gravity_window.h"
+#include <glibmm/main.h>
+#include <cairomm/context.h>
+#include <gtkmm/cssprovider.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+Gravity_Window::Gravity_Window() :
+    side_box(Gtk::ORIENTATION_VERTICAL, 0),
+
+    title(       "Gravity"      ),
+    reset(       "Reset"        ),
+    clear(       "Clear"        ),
+    pause(       "Pause"        ),
+    save(        "Save"         ),
+    load(        "Load"         ),
+    record(      "Record"       ),
+    replay(      "Replay"       ),
+    replay_seek( Gtk::ORIENTATION_HORIZONTAL),
+    recording(   false          ),
+    seek_moving( false          ),
+    profile(     "Show Profile" ),
+    export_profile("Export Profile"),
+    traillabel(  "Trail Length" ),
+    trailvalue(  "360"          ),
+    framelabel(  "Framerate"    ),
+    framevalue(  "60.0"         ),
+    timelabel(   "Time Scale"   ),
+    timevalue(   "1.00"         ),
+    dtlabel(     "Step Size"    ),
+    dtvalue(     "1.00"         ),
+    thetalabel(  "Theta"        ),
+    thetavalue(  "0.50"         ),
+    meshlabel(   "Mesh Size"    ),
+    meshvalue(   "256"          ),
+    threadlabel( "Threads"      ),
+    densitylabel("Density Above"),
+    densityvalue("16384"        ),
+
+    instructions("Move around by dragging,\nzoom with scroll wheel;\nto add new bodies right\nclick and hold, then drag."),
+
+    framerate(Gtk::ORIENTATION_HORIZONTAL),
+    timescale(Gtk::ORIENTATION_HORIZONTAL),
+    dt(Gtk::ORIENTATION_HORIZONTAL),
+    theta(Gtk::ORIENTATION_HORIZONTAL),
+    mesh(Gtk::ORIENTATION_HORIZONTAL),
+    threads(Gtk::ORIENTATION_HORIZONTAL),
+    density(Gtk::ORIENTATION_HORIZONTAL) {
+
+    // set window border and title
+    set_border_width(10);
+    set_title("Gravity");
+    set_default_size(1000, 800);
+
+    // place main_box in window and side_box in main_box
+    add(main_box);
+    side_box.set_margin_left(15);
+    main_box.pack_start(side_box, Gtk::PACK_SHRINK, 0);
+
+    /* add widgets to boxes */
+
+    // setup title label
+    title.set_markup("<span font_weight=\"bold\" font_size=\"larger\">Gravity</span>");
+    title.set_width_chars(20);
+    side_box.pack_start(title, Gtk::PACK_SHRINK, 0);
+
+    // setup reset button
+    reset.set_margin_top(15);
+    side_box.pack_start(reset, Gtk::PACK_SHRINK, 0);
+    reset.signal_clicked().connect( [this](){reset_sim();} );
+
+    // setup clear button
+    clear.set_margin_top(5);
+    side_box.pack_start(clear, Gtk::PACK_SHRINK, 0);
+    clear.signal_clicked().connect( [this](){gravity_draw.clear();} );
+
+    // setup pause button
+    pause.set_margin_top(5);
+    side_box.pack_start(pause, Gtk::PACK_SHRINK, 0);
+    pause.signal_clicked().connect( [this](){toggle_pause();} );
+
+    // setup save and load buttons
+    save.set_margin_top(5);
+    side_box.pack_start(save, Gtk::PACK_SHRINK, 0);
+    save.signal_clicked().connect( [this](){save_clicked();} );
+
+    load.set_margin_top(5);
+    side_box.pack_start(load, Gtk::PACK_SHRINK, 0);
+    load.signal_clicked().connect( [this](){load_clicked();} );
+
+    // setup record and replay buttons
+    record.set_margin_top(5);
+    side_box.pack_start(record, Gtk::PACK_SHRINK, 0);
+    record.signal_clicked().connect( [this](){record_clicked();} );
+
+    replay.set_margin_top(5);
+    side_box.pack_start(replay, Gtk::PACK_SHRINK, 0);
+    replay.signal_clicked().connect( [this](){replay_clicked();} );
+
+    // setup replay position scale - only usable while replaying
+    side_box.pack_start(replay_seek, Gtk::PACK_SHRINK, 0);
+    seek_adjust_ptr = Gtk::Adjustment::create(0.0, 0.0, 1.0, 1.0, 10.0, 0.0);
+    replay_seek.set_adjustment(seek_adjust_ptr);
+    seek_adjust_ptr->signal_value_changed().connect( [this](){seek_changed();} );
+    replay_seek.set_draw_value(false);
+    replay_seek.set_sensitive(false);
+
+    // setup profile toggle and export button
+    profile.set_margin_top(5);
+    side_box.pack_start(profile, Gtk::PACK_SHRINK, 0);
+    profile.signal_toggled().connect( [this](){profile_toggled();} );
+
+    side_box.pack_start(export_profile, Gtk::PACK_SHRINK, 0);
+    export_profile.signal_clicked().connect( [this](){export_clicked();} );
+
+    // setup trail scale labels
+    trail_box.set_margin_top(15);
+    side_box.pack_start(trail_box,    Gtk::PACK_SHRINK, 0);
+    trail_box.pack_start(traillabel,  Gtk::PACK_SHRINK, 0);
+    trail_box.pack_start(trailspacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    trail_box.pack_start(trailvalue,  Gtk::PACK_SHRINK, 0);
+    
+    // setup trail scale
+    side_box.pack_start(traillength, Gtk::PACK_SHRINK, 0);
+    traillength_adjust_ptr = Gtk::Adjustment::create(360.0, 0.0, 1001.0, 1.0, 1.0, 1.0);
+    traillength.set_adjustment(traillength_adjust_ptr);
+    traillength_adjust_ptr->signal_value_changed().connect( [this](){traillength_changed();} );
+    traillength.set_draw_value(false);
+
+    // setup framerate scale labels
+    side_box.pack_start(frame_box,    Gtk::PACK_SHRINK, 0);
+    frame_box.pack_start(framelabel,  Gtk::PACK_SHRINK, 0);
+    frame_box.pack_start(framespacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    frame_box.pack_start(framevalue,  Gtk::PACK_SHRINK, 0);
+    
+    // setup framerate scale
+    side_box.pack_start(framerate, Gtk::PACK_SHRINK, 0);
+    framerate_adjust_ptr = Gtk::Adjustment::create(60.0, 5.0, 145.0, 0.1, 1.0, 1.0);
+    framerate.set_adjustment(framerate_adjust_ptr);
+    framerate_adjust_ptr->signal_value_changed().connect( [this](){framerate_changed();} );
+    framerate.set_draw_value(false);
+
+    // setup time scale labels
+    side_box.pack_start(time_box,   Gtk::PACK_SHRINK, 0);
+    time_box.pack_start(timelabel,  Gtk::PACK_SHRINK, 0);
+    time_box.pack_start(timespacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    time_box.pack_start(timevalue,  Gtk::PACK_SHRINK, 0);
+
+    // setup time scale
+    side_box.pack_start(timescale, Gtk::PACK_SHRINK, 0);
+    timescale_adjust_ptr = Gtk::Adjustment::create(1.0, -1.0, 11.0, 0.1, 1.0, 1.0);
+    timescale.set_adjustment(timescale_adjust_ptr);
+    timescale_adjust_ptr->signal_value_changed().connect( [this](){timescale_changed();} );
+    timescale.set_draw_value(false);
+
+    // setup step size labels
+    side_box.pack_start(dt_box,   Gtk::PACK_SHRINK, 0);
+    dt_box.pack_start(dtlabel,  Gtk::PACK_SHRINK, 0);
+    dt_box.pack_start(dtspacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    dt_box.pack_start(dtvalue,  Gtk::PACK_SHRINK, 0);
+
+    // setup step size scale
+    side_box.pack_start(dt, Gtk::PACK_SHRINK, 0);
+    dt_adjust_ptr = Gtk::Adjustment::create(1.0, 0.1, 4.0, 0.05, 0.5, 0.0);
+    dt.set_adjustment(dt_adjust_ptr);
+    dt_adjust_ptr->signal_value_changed().connect( [this](){dt_changed();} );
+    dt.set_draw_value(false);
+
+    // setup force method selector
+    method.set_margin_top(15);
+    side_box.pack_start(method, Gtk::PACK_SHRINK, 0);
+    method.append("Direct sum");
+    method.append("Barnes-Hut");
+    method.append("Particle mesh");
+    method.append("P3M");
+    method.append("Cell list");
+    method.set_active(DIRECT_SUM);
+    method.signal_changed().connect( [this](){method_changed();} );
+
+    // setup theta scale labels
+    side_box.pack_start(theta_box,    Gtk::PACK_SHRINK, 0);
+    theta_box.pack_start(thetalabel,  Gtk::PACK_SHRINK, 0);
+    theta_box.pack_start(thetaspacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    theta_box.pack_start(thetavalue,  Gtk::PACK_SHRINK, 0);
+
+    // setup theta scale
+    side_box.pack_start(theta, Gtk::PACK_SHRINK, 0);
+    theta_adjust_ptr = Gtk::Adjustment::create(0.5, 0.0, 1.5, 0.01, 0.1, 0.0);
+    theta.set_adjustment(theta_adjust_ptr);
+    theta_adjust_ptr->signal_value_changed().connect( [this](){theta_changed();} );
+    theta.set_draw_value(false);
+
+    // setup mesh size scale labels
+    side_box.pack_start(mesh_box,    Gtk::PACK_SHRINK, 0);
+    mesh_box.pack_start(meshlabel,   Gtk::PACK_SHRINK, 0);
+    mesh_box.pack_start(meshspacer,  Gtk::PACK_EXPAND_WIDGET, 0);
+    mesh_box.pack_start(meshvalue,   Gtk::PACK_SHRINK, 0);
+
+    // setup mesh size scale - the slider picks the power of 2
+    side_box.pack_start(mesh, Gtk::PACK_SHRINK, 0);
+    mesh_adjust_ptr = Gtk::Adjustment::create(8.0, 5.0, 10.0, 1.0, 1.0, 0.0);
+    mesh.set_adjustment(mesh_adjust_ptr);
+    mesh_adjust_ptr->signal_value_changed().connect( [this](){mesh_changed();} );
+    mesh.set_draw_value(false);
+
+    // setup thread count labels
+    side_box.pack_start(thread_box,     Gtk::PACK_SHRINK, 0);
+    thread_box.pack_start(threadlabel,  Gtk::PACK_SHRINK, 0);
+    thread_box.pack_start(threadspacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    thread_box.pack_start(threadvalue,  Gtk::PACK_SHRINK, 0);
+    threadvalue.set_label(std::to_string(gravity_draw.threads));
+
+    // setup thread count scale
+    side_box.pack_start(threads, Gtk::PACK_SHRINK, 0);
+    threads_adjust_ptr = Gtk::Adjustment::create(gravity_draw.threads, 1.0, gravity_draw.threads + 1.0, 1.0, 1.0, 1.0);
+    threads.set_adjustment(threads_adjust_ptr);
+    threads_adjust_ptr->signal_value_changed().connect( [this](){threads_changed();} );
+    threads.set_draw_value(false);
+
+    // setup density labels
+    side_box.pack_start(density_box,      Gtk::PACK_SHRINK, 0);
+    density_box.pack_start(densitylabel,  Gtk::PACK_SHRINK, 0);
+    density_box.pack_start(densityspacer, Gtk::PACK_EXPAND_WIDGET, 0);
+    density_box.pack_start(densityvalue,  Gtk::PACK_SHRINK, 0);
+
+    // setup density scale - the slider picks the power of 2, and its far end never splats
+    side_box.pack_start(density, Gtk::PACK_SHRINK, 0);
+    density_adjust_ptr = Gtk::Adjustment::create(14.0, 10.0, 22.0, 1.0, 1.0, 1.0);
+    density.set_adjustment(density_adjust_ptr);
+    density_adjust_ptr->signal_value_changed().connect( [this](){density_changed();} );
+    density.set_draw_value(false);
+
+    // setup instructions label
+    side_box.pack_start(instructions, Gtk::PACK_SHRINK, 0);
+
+    // setup gravity_draw pane
+    gravity_draw.set_margin_left(25);
+    gravity_draw.set_hexpand(true);
+    gravity_draw.set_vexpand(true);
+    main_box.pack_start(gravity_draw);
+
+
+    show_all_children();
+}
+
+void Gravity_Window::reset_sim() {
+
+    // resets slider values back to intial and then calls method to reset members of gravity_draw
+    traillength_adjust_ptr->set_value(360.0);
+    framerate_adjust_ptr->set_value(60.0);
+    timescale_adjust_ptr->set_value(1.0);
+    dt_adjust_ptr->set_value(1.0);
+    theta_adjust_ptr->set_value(0.5);
+    mesh_adjust_ptr->set_value(8.0);
+    density_adjust_ptr->set_value(14.0);
+    gravity_draw.reset();
+}
+
+void Gravity_Window::toggle_pause() {
+
+    // toggle the value of the pause variable and the text on the button
+    gravity_draw.paused = !gravity_draw.paused;
+    gravity_draw.pause_changed();
+    pause.set_label(gravity_draw.paused ? "Unpause" : "Pause");
+}
+
+void Gravity_Window::save_clicked() {
+
+    // ask where to save, then let gravity_draw write the snapshot between steps
+    Gtk::FileChooserDialog dialog(*this, "Save Snapshot", Gtk::FILE_CHOOSER_ACTION_SAVE);
+    dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Save",   Gtk::RESPONSE_OK);
+    dialog.set_do_overwrite_confirmation(true);
+    dialog.set_current_name("gravity.snap");
+
+    if(dialog.run() == Gtk::RESPONSE_OK) { gravity_draw.save(dialog.get_filename()); }
+}
+
+void Gravity_Window::load_clicked() {
+
+    Gtk::FileChooserDialog dialog(*this, "Load Snapshot", Gtk::FILE_CHOOSER_ACTION_OPEN);
+    dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Load",   Gtk::RESPONSE_OK);
+
+    if(dialog.run() == Gtk::RESPONSE_OK) { load_scene(dialog.get_filename()); }
+}
+
+void Gravity_Window::record_clicked() {
+
+    // the button starts a recording or stops the one in progress
+    if(recording) {
+
+        gravity_draw.stop_recording();
+        record.set_label("Record");
+        recording = false;
+        return;
+    }
+
+    Gtk::FileChooserDialog dialog(*this, "Record Trajectory", Gtk::FILE_CHOOSER_ACTION_SAVE);
+    dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Record", Gtk::RESPONSE_OK);
+    dialog.set_do_overwrite_confirmation(true);
+    dialog.set_current_name("gravity.traj");
+
+    if(dialog.run() == Gtk::RESPONSE_OK) {
+
+        gravity_draw.start_recording(dialog.get_filename());
+        record.set_label("Stop Recording");
+        recording = true;
+    }
+}
+
+void Gravity_Window::replay_clicked() {
+
+    // the button starts a replay or stops the one in progress
+    if(gravity_draw.replay_frames > 0) {
+
+        gravity_draw.stop_replay();
+        replay.set_label("Replay");
+        replay_seek.set_sensitive(false);
+        return;
+    }
+
+    Gtk::FileChooserDialog dialog(*this, "Replay Trajectory", Gtk::FILE_CHOOSER_ACTION_OPEN);
+    dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Replay", Gtk::RESPONSE_OK);
+
+    if(dialog.run() == Gtk::RESPONSE_OK && gravity_draw.start_replay(dialog.get_filename())) {
+
+        seek_moving = true;
+        seek_adjust_ptr->set_upper(gravity_draw.replay_frames);
+        seek_adjust_ptr->set_value(0);
+        seek_moving = false;
+
+        replay.set_label("Stop Replay");
+        replay_seek.set_sensitive(true);
+
+        // follow the replay with the slider until it stops
+        Glib::signal_timeout().connect( [this](){return update_seek();}, 100 );
+    }
+}
+
+void Gravity_Window::seek_changed() {
+
+    // only a drag by the user seeks, not the slider following the replay
+    if(seek_moving || gravity_draw.replay_frames == 0) { return; }
+
+    gravity_draw.seek(seek_adjust_ptr->get_value());
+}
+
+bool Gravity_Window::update_seek() {
+
+    // returning false disconnects the timeout once the replay has stopped
+    if(gravity_draw.replay_frames == 0) { return false; }
+
+    seek_moving = true;
+    seek_adjust_ptr->set_value(gravity_draw.replay_position);
+    seek_moving = false;
+
+    return true;
+}
+
+void Gravity_Window::profile_toggled() {
+
+    gravity_draw.show_profile(profile.get_active());
+}
+
+void Gravity_Window::export_clicked() {
+
+    Gtk::FileChooserDialog dialog(*this, "Export Profile", Gtk::FILE_CHOOSER_ACTION_SAVE);
+    dialog.add_button("Cancel", Gtk::RESPONSE_CANCEL);
+    dialog.add_button("Export", Gtk::RESPONSE_OK);
+    dialog.set_do_overwrite_confirmation(true);
+    dialog.set_current_name("profile.csv");
+
+    if(dialog.run() == Gtk::RESPONSE_OK) { gravity_draw.export_profile(dialog.get_filename()); }
+}
+
+bool Gravity_Window::load_scene(const std::string &path) {
+
+    // mapping the file is quick whatever its size, and the bodies are copied out on the stepper thread
+    auto file = std::make_shared<Snapshot_File>();
+
+    if(!file->open(path)) {
+
+        std::cerr << file->error << "\n";
+        return false;
+    }
+
+    // the stepper copies the sliders into the simulation every step, so they take the snapshot's settings
+    const Snapshot_Header &header = file->header();
+    traillength_adjust_ptr->set_value(header.traillength);
+    timescale_adjust_ptr->set_value(header.timescale);
+    dt_adjust_ptr->set_value(header.dt);
+    theta_adjust_ptr->set_value(header.theta);
+    mesh_adjust_ptr->set_value(std::round(std::log2(header.mesh_size)));
+    method.set_active(header.force_method);
+
+    gravity_draw.restore(file);
+
+    return true;
+}
+
+void Gravity_Window::traillength_changed() {
+    
+    // gets the value from the adjustment pointer and sets the traillength label to the new value
+    gravity_draw.traillength = traillength_adjust_ptr->get_value();
+    gravity_draw.wake();
+    std::string text = std::to_string(gravity_draw.traillength);
+    trailvalue.set_label(text);
+}
+
+void Gravity_Window::framerate_changed() {
+
+    // gets the value from the adjustment pointer, calls the method of gravity_draw to respond to the
+    // change and sets the framevalue label to the first 4 characters of the new value
+    gravity_draw.framerate = framerate_adjust_ptr->get_value();
+    gravity_draw.framerate_changed();
+    std::string text = std::to_string(gravity_draw.framerate).substr(0, 4);
+    framevalue.set_label(text);
+}
+
+void Gravity_Window::timescale_changed() {
+
+    // gets the value from the adjustment pointer and sets the framevalue label to
+    // the first 4 characters of the new value
+    gravity_draw.timescale = timescale_adjust_ptr->get_value();
+    std::string text = std::to_string(gravity_draw.timescale).substr(0, 4);
+    timevalue.set_label(text);
+}
+
+void Gravity_Window::dt_changed() {
+
+    // gets the value from the adjustment pointer and sets the dtvalue label to
+    // the first 4 characters of the new value
+    gravity_draw.dt = dt_adjust_ptr->get_value();
+    std::string text = std::to_string(gravity_draw.dt).substr(0, 4);
+    dtvalue.set_label(text);
+}
+
+void Gravity_Window::method_changed() {
+
+    // the rows of the selector are in the same order as the Force_Method enum
+    gravity_draw.force_method = (Force_Method) method.get_active_row_number();
+}
+
+void Gravity_Window::mesh_changed() {
+
+    // the slider moves in whole powers of 2, which the mesh needs for its transforms
+    int power = std::round(mesh_adjust_ptr->get_value());
+    gravity_draw.mesh_size = 1 << power;
+    meshvalue.set_label(std::to_string(gravity_draw.mesh_size));
+}
+
+void Gravity_Window::threads_changed() {
+
+    // gets the value from the adjustment pointer, restarts the worker threads of gravity_draw
+    // and sets the threadvalue label to the new value
+    int value = threads_adjust_ptr->get_value();
+    if(value == gravity_draw.threads) { return; }
+
+    gravity_draw.threads = value;
+    gravity_draw.threads_changed();
+    threadvalue.set_label(std::to_string(gravity_draw.threads));
+}
+
+void Gravity_Window::density_changed() {
+
+    // below 2^21 bodies the slider picks the power of 2 to splat from, and at the end never splats
+    int power  = std::round(density_adjust_ptr->get_value());
+    int bodies = power > 20 ? 0 : 1 << power;
+
+    gravity_draw.set_density_bodies(bodies);
+    densityvalue.set_label(bodies > 0 ? std::to_string(bodies) : "never");
+}
+
+void Gravity_Window::theta_changed() {
+
+    // gets the value from the adjustment pointer and sets the thetavalue label to
+    // the first 4 characters of the new value
+    gravity_draw.theta = theta_adjust_ptr->get_value();
+    std::string text = std::to_string(gravity_draw.theta).substr(0, 4);
+    thetavalue.set_label(text);
+}
+
+
+
+Gravity_Draw::Gravity_Draw() :
+    paused(false),
+    mouse_info{0, 0, 0, 0, false, 0},
+    background{0, 0, 0},
+    framerate(60.0),
+    timescale(1.0),
+    dt(1.0),
+    force_method(DIRECT_SUM),
+    theta(0.5),
+    mesh_size(256),
+    threads(std::max(1u, std::thread::hardware_concurrency())),
+    sim(threads),
+    published_step(0),
+    replay_frames(0),
+    replay_position(0),
+    replay_next(0),
+    stopping(false),
+    stepper_woken(false),
+    steps_done(0),
+    full_trails_wanted(true),
+    ticking(false),
+    dirty(false),
+    frame_time(0),
+    change_time(0),
+    rate_steps(0),
+    rate_draws(0),
+    sim_rate(0),
+    ui_rate(0),
+    renderer(threads) {
+
+    // set members to intial values
+    reset();
+
+    // the simulation adds its timings and counters to the shared profiler while it is enabled
+    sim.profiler = &profiler;
+
+    // each snapshot the stepper publishes wakes the frame clock to draw it
+    published_signal.connect( [this](){wake();} );
+
+    // start stepping the simulation on its own thread
+    rate_time = std::chrono::steady_clock::now();
+    stepper   = std::thread( [this](){step_loop();} );
+
+    // lets the widget detect the events it needs to
+    set_events(Gdk::SCROLL_MASK | Gdk::POINTER_MOTION_MASK | Gdk::BUTTON_PRESS_MASK | Gdk::BUTTON_RELEASE_MASK);    
+}
+
+Gravity_Draw::~Gravity_Draw() {
+
+    // tell the stepper thread to finish its current step and exit
+    {
+        std::lock_guard<std::mutex> guard(command_lock);
+        stopping = true;
+    }
+
+    command_wake.notify_all();
+    stepper.join();
+}
+
+void Gravity_Draw::reset() {
+
+    // set variables to initial values - the bodies are replaced on the stepper thread
+    post( [this](){sim.reset();} );
+                    
+    zoom        = 1.0;
+    centre      = {350, 320};
+    traillength = 360;
+
+    invalidate_trails();
+}
+
+void Gravity_Draw::clear() {
+
+    // remove all bodies
+    post( [this](){sim.clear();} );
+
+    // set background to white causing a flash upon clearing bodies
+    background = {1.0, 1.0, 1.0};
+
+    invalidate_trails();
+}
+
+void Gravity_Draw::save(const std::string &path) {
+
+    // the view is taken now, the bodies when the stepper next runs its commands
+    Snapshot_View view;
+    view.zoom      = zoom;
+    view.centre[0] = centre[0];
+    view.centre[1] = centre[1];
+    view.timescale = timescale;
+
+    post( [this, path, view](){
+
+        if(!save_snapshot(path, sim, view)) { std::cerr << "couldn't write a snapshot to " << path << "\n"; }
+    } );
+}
+
+void Gravity_Draw::restore(std::shared_ptr<Snapshot_File> file) {
+
+    // the view belongs to the ui thread, the bodies to the stepper - the file stays mapped until both are done
+    const Snapshot_Header &header = file->header();
+    zoom   = header.zoom;
+    centre = {header.centre[0], header.centre[1]};
+
+    post( [this, file](){
+
+        Snapshot_View view;
+        file->restore(sim, view);
+    } );
+
+    invalidate_trails();
+}
+
+void Gravity_Draw::start_recording(const std::string &path) {
+
+    // positions are rounded to a hundredth, far below a pixel at any usable zoom
+    post( [this, path](){
+
+        if(!recorder.open(path, 0.01)) { std::cerr << "couldn't write a trajectory to " << path << "\n"; }
+    } );
+}
+
+void Gravity_Draw::show_profile(bool show) {
+
+    // start each profile afresh so the percentiles aren't mixed with an earlier run
+    if(show) { profiler.clear(); }
+    profiler.enabled = show;
+
+    wake();
+}
+
+bool Gravity_Draw::export_profile(const std::string &path) {
+
+    std::ofstream out(path);
+    profiler.write_csv(out);
+
+    if(!out) {
+
+        std::cerr << "couldn't write the profile to " << path << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+void Gravity_Draw::stop_recording() {
+
+    post( [this](){recorder.close();} );
+}
+
+bool Gravity_Draw::start_replay(const std::string &path) {
+
+    // the frames are indexed here so a bad file is reported straight away
+    auto reader = std::make_shared<Trajectory_Reader>();
+
+    if(!reader->open(path) || reader->frames() == 0) {
+
+        std::cerr << (reader->error.empty() ? path + " has no frames" : reader->error) << "\n";
+        return false;
+    }
+
+    replay_frames   = reader->frames();
+    replay_position = 0;
+
+    post( [this, reader](){
+
+        // keep the bodies to go back to, unless already replaying
+        if(!replay) { before_replay = sim.bodies; }
+
+        replay      = reader;
+        replay_next = 0;
+        replay_step();
+    } );
+
+    invalidate_trails();
+
+    return true;
+}
+
+void Gravity_Draw::stop_replay() {
+
+    replay_frames = 0;
+
+    post( [this](){
+
+        if(!replay) { return; }
+
+        replay.reset();
+        sim.clear();
+        sim.bodies = before_replay;
+    } );
+
+    invalidate_trails();
+}
+
+void Gravity_Draw::seek(long frame) {
+
+    post( [this, frame](){
+
+        if(!replay) { return; }
+
+        // the trails are started again from the new frame
+        replay_next = std::max(0L, std::min(frame, replay->frames() - 1));
+        if(replay->read(replay_next, replay_frame)) { show_frame(replay_frame, sim, true); }
+
+        replay_position = replay_next++;
+    } );
+
+    invalidate_trails();
+}
+
+bool Gravity_Draw::replay_step() {
+
+    // hold the last frame once the replay reaches the end
+    if(replay_next >= replay->frames()) { return false; }
+
+    if(!replay->read(replay_next, replay_frame)) {
+
+        std::cerr << replay->error << "\n";
+        replay_next = replay->frames();
+        return false;
+    }
+
+    show_frame(replay_frame, sim, replay_next == 0);
+    replay_position = replay_next++;
+
+    return true;
+}
+
+void Gravity_Draw::post(std::function<void()> command) {
+
+    {
+        std::lock_guard<std::mutex> guard(command_lock);
+        commands.push_back(std::move(command));
+    }
+
+    command_wake.notify_all();
+}
+
+void Gravity_Draw::wake_stepper() {
+
+    {
+        std::lock_guard<std::mutex> guard(command_lock);
+        stepper_woken = true;
+    }
+
+    command_wake.notify_all();
+}
+
+bool Gravity_Draw::run_commands() {
+
+    // take the queued commands under the lock, then run them without holding it
+    std::vector<std::function<void()>> queued;
+    {
+        std::lock_guard<std::mutex> guard(command_lock);
+        queued.swap(commands);
+    }
+
+    for(auto &command : queued) { command(); }
+
+    return !queued.empty();
+}
+
+void Gravity_Draw::step_loop() {
+
+    auto next    = std::chrono::steady_clock::now();
+    auto last    = next;
+    bool changed = true; // the bodies have changed since the last snapshot was published
+
+    while(true) {
+
+        if(run_commands()) { changed = true; }
+
+        // real time since the last pass - a simulated time of 60 per second at a time scale of 1
+        auto   now     = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last           = now;
+
+        // while replaying, show the next recorded frame in place of any physics
+        if(replay) {
+
+            sim.traillength = traillength;
+            if(!paused && replay_step()) { changed = true; }
+        }
+
+        // advance simulation if it isnt paused, with the latest settings from the ui
+        else if(!paused) {
+
+            sim.traillength  = traillength;
+            sim.dt           = dt;
+            sim.force_method = force_method;
+            sim.theta        = theta;
+            sim.mesh_size    = mesh_size;
+
+            // the integrator takes as many fixed substeps as fit in the time, so the
+            // orbits no longer depend on the framerate or on how long the last pass took
+            if(sim.advance(elapsed * 60 * timescale) > 0) {
+
+                recorder.record(sim);
+                if(sim.bodies.size() > 0) { changed = true; }
+            }
+
+            steps_done = sim.steps;
+        }
+
+        // only copy the bodies out if they have changed, or the ui wants whole trails, and once the
+        // last snapshot has been picked up for drawing - then wake the ui to draw it
+        if(full_trails_wanted) { changed = true; }
+
+        if(changed && !snapshots.pending()) {
+
+            publish();
+            published_signal.emit();
+            changed = false;
+        }
+
+        // nothing will change until the ui asks for something while paused, with no bodies to step
+        // or once a replay has ended
+        bool idle = paused || (replay ? replay_next >= replay->frames() : sim.bodies.size() == 0);
+
+        // wait until the next pass is due, without trying to catch up after falling behind
+        now   = std::chrono::steady_clock::now();
+        next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0/framerate));
+        if(next < now) { next = now; }
+
+        std::unique_lock<std::mutex> guard(command_lock);
+        auto woken = [this](){return stopping || stepper_woken || !commands.empty();};
+
+        if(idle && !changed) {
+
+            // sleep until woken, and don't count the time asleep as time to simulate
+            command_wake.wait(guard, woken);
+            next = last = std::chrono::steady_clock::now();
+        }
+        else {
+
+            command_wake.wait_until(guard, next, woken);
+        }
+
+        stepper_woken = false;
+
+        if(stopping) { return; }
+    }
+}
+
+void Gravity_Draw::publish() {
+
+    // whole trails are only copied when the ui has to redraw its trail cache
+    take_snapshot(sim, full_trails_wanted.exchange(false), published_step, snapshots.back());
+    published_step = sim.trail_steps;
+
+    snapshots.publish();
+}
+
+bool Gravity_Draw::on_draw(const Cairo::RefPtr<Cairo::Context>& cr) {
+
+    // newest state published by the stepper thread - never modified while we draw it
+    const Draw_Snapshot &snapshot = snapshots.front();
+    int n = snapshot.m.size();
+
+    Scoped_Timer draw_timer(&profiler, PROFILE_DRAW);
+
+    // paint background
+    {
+        Scoped_Timer timer(&profiler, PROFILE_DRAW_BACKGROUND);
+
+        cr -> set_source_rgb(background[0], background[1], background[2]);
+        cr -> paint();
+    }
+
+    // set line cap style
+    cr -> set_line_cap(Cairo::LINE_CAP_ROUND);
+
+    // draw the cached trails, adding the newest segments to the cache first - a resized
+    // widget also leaves the cache stale, so ask for whole trails until it has been redrawn
+    {
+        Scoped_Timer timer(&profiler, PROFILE_DRAW_TRAILS);
+
+        renderer.draw_trails(cr, get_allocated_width(), get_allocated_height(), snapshot, zoom, centre, traillength);
+
+        if(renderer.trails_stale()) {
+
+            full_trails_wanted = true;
+            wake_stepper();
+        }
+    }
+
+    // draw the bodies over the trails
+    {
+        Scoped_Timer timer(&profiler, PROFILE_DRAW_BODIES);
+
+        renderer.draw_bodies(cr, get_allocated_width(), get_allocated_height(), snapshot, zoom, centre);
+    }
+
+    // if the mouse is right clicked...
+    if(mouse_info.clicked) {
+
+        // draw a blue line from where the click happened to the current mouse position
+        cr -> set_source_rgb(0.1, 0.6, 0.8);
+        cr -> move_to(mouse_info.click_x, mouse_info.click_y);
+        cr -> line_to(mouse_info.x, mouse_info.y);
+        cr -> stroke();
+
+        // draw a blue circle where the click happened 
+        cr -> arc(mouse_info.click_x, mouse_info.click_y, 10*mouse_info.click_time*zoom, 0, M_PI*2);
+        cr -> set_source_rgb(0.0, 0.0, 0.0);
+        cr -> fill_preserve();
+        cr -> set_source_rgb(0.1, 0.6, 0.8);
+        cr -> stroke();
+    }
+
+    // show the simulation and drawing rates separately in the top left corner
+    std::string stats = "sim " + std::to_string((int) sim_rate) + " steps/s   ui " + std::to_string((int) ui_rate) + " fps";
+
+    // and the memory used by trails for each body
+    if(n > 0) { stats += "   trails " + std::to_string(snapshot.trail_bytes / n / 1024) + " KB/body"; }
+    cr -> set_source_rgb(0.6, 0.6, 0.6);
+    cr -> set_font_size(12);
+    cr -> move_to(10, 20);
+    cr -> show_text(stats);
+
+    // list the profiled percentiles under the rates - the draw being timed shows up from the next frame
+    if(profiler.enabled) { renderer.draw_profile(cr, profiler, 10, 44); }
+
+    rate_draws++;
+
+    return true;
+}
+
+void Gravity_Draw::invalidate_trails() {
+
+    // the renderer redraws its trail cache once the stepper sends whole trails
+    renderer.invalidate_trails();
+    full_trails_wanted = true;
+
+    wake_stepper();
+    wake();
+}
+
+void Gravity_Draw::wake() {
+
+    dirty = true;
+    if(ticking) { return; }
+
+    // the rates start again after being idle rather than averaging over the time spent idle
+    rate_time  = std::chrono::steady_clock::now();
+    rate_steps = steps_done;
+    rate_draws = 0;
+
+    ticking    = true;
+    frame_time = 0;
+    add_tick_callback( sigc::mem_fun(*this, &Gravity_Draw::on_tick) );
+}
+
+bool Gravity_Draw::on_tick(const Glib::RefPtr<Gdk::FrameClock> &clock) {
+
+    // the animations move with the time between frames from the frame clock, so they keep their
+    // speed at any refresh rate and when frames are dropped
+    gint64 time     = clock->get_frame_time();
+    double interval = frame_time > 0 ? std::min((time - frame_time) * 1e-6, 0.25) : 0;
+    frame_time      = time;
+
+    // fade the background back to black after the flash of clearing the bodies
+    if(background[0] > 0) {
+
+        for(double &c : background) { c = std::max(0.0, c - 3 * interval); }
+        dirty = true;
+    }
+
+    // a right click held still grows the body it will add
+    if(mouse_info.clicked) {
+
+        if(mouse_info.click_x == mouse_info.x && mouse_info.click_y == mouse_info.y) { mouse_info.click_time += 1.8 * interval; }
+        dirty = true;
+    }
+
+    // update the measured rates about once a second
+    auto   now     = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - rate_time).count();
+
+    if(elapsed >= 1.0) {
+
+        long done  = steps_done;
+        sim_rate   = (done - rate_steps) / elapsed;
+        ui_rate    = rate_draws / elapsed;
+        rate_time  = now;
+        rate_steps = done;
+        rate_draws = 0;
+    }
+
+    // only draw a frame if something in it has changed - a frame drawn only because the view is dirty
+    // shows the same snapshot again, which the renderer just blits from its trail cache
+    if(dirty || snapshots.pending()) {
+
+        queue_draw();
+        dirty       = false;
+        change_time = time;
+
+        return true;
+    }
+
+    // stop ticking once nothing has changed for a quarter of a second, until wake is called again - a
+    // frame or two without a new snapshot is only the stepper and the display being out of phase
+    if(time - change_time < 250000) { return true; }
+
+    // draw the rates as zero rather than leaving the last ones up while idle
+    sim_rate = 0;
+    ui_rate  = 0;
+    ticking  = false;
+    queue_draw();
+
+    return false;
+}
+
+bool Gravity_Draw::on_scroll_event(GdkEventScroll * scroll_event) {
+
+    // store previous zoom level for arithmatic later
+    prev_zoom  = zoom;
+
+    // zoom in or out depending on scroll_event->direction - 0 when scrolling down and 1 when scrolling up
+    zoom      *=  scroll_event->direction ? 0.95 : 1.05;
+
+    // move centre of coordinate system such that the zoom is centred on the mouse position
+    centre[0] += (scroll_event->x - centre[0])/zoom * (prev_zoom-zoom);
+    centre[1] += (scroll_event->y - centre[1])/zoom * (prev_zoom-zoom);
+
+    // the cached trails were drawn for the old view
+    invalidate_trails();
+
+    return true;
+}
+
+bool Gravity_Draw::on_button_press_event(GdkEventButton * button_event) {
+
+    // if mouse button 3 is pressed, store mouse info
+    if(button_event->button == 3) {
+
+        mouse_info.click_x = button_event->x;
+        mouse_info.click_y = button_event->y;
+        mouse_info.clicked = true;
+
+        wake();
+    }
+
+    return true;
+}
+
+bool Gravity_Draw::on_button_release_event(GdkEventButton * button_event) {
+
+    // is mouse button 3 is released...
+    if(button_event->button == 3) {
+    
+        // calculate coordinates of new body from screen coordinates of mouse click
+        double nx = (mouse_info.click_x - centre[0])/zoom;
+        double ny = (mouse_info.click_y - centre[1])/zoom;
+
+        // calculate velocity of new body from the drag of the mouse while right clicked
+        double dx = (mouse_info.x - mouse_info.click_x)/50;
+        double dy = (mouse_info.y - mouse_info.click_y)/50;
+
+        // add new body by adding new element to vectors storing body info
+        Body body = { {nx,ny}, {dx, dy}, mouse_info.click_time };
+        post( [this, body](){sim.add(body);} );
+
+        // store mouse info
+        mouse_info.clicked    = false;
+        mouse_info.click_time = 0.0;
+
+        wake();
+    }
+
+    return true;
+}
+
+bool Gravity_Draw::on_motion_notify_event(GdkEventMotion * motion_event) {
+
+    // if mouse button 1 is pressed...
+    if(motion_event->state & GDK_BUTTON1_MASK) {
+
+        // calculate motion of mouse in x and y
+        double dx  = motion_event->x - mouse_info.x;
+        double dy  = motion_event->y - mouse_info.y;
+    
+        // shift centre of coordinate system by this amount to drag simulation around
+        centre[0] += dx;
+        centre[1] += dy;
+
+        // the cached trails were drawn for the old view
+        invalidate_trails();
+    }
+
+    // store new mouse position
+    mouse_info.x = motion_event->x;
+    mouse_info.y = motion_event->y;
+
+    return true;
+}
+
+void Gravity_Draw::pause_changed() {
+
+    // the stepper sleeps while paused, so it has to be woken to carry on
+    wake_stepper();
+}
+
+void Gravity_Draw::framerate_changed() {
+
+    // the stepper thread reads the new framerate when scheduling its next pass - drawing follows the
+    // frame clock and is unaffected
+}
+
+void Gravity_Draw::threads_changed() {
+
+    // restart the pool with the new number of worker threads between steps - only the ui thread
+    // draws, so the renderer's threads can be restarted directly
+    int count = threads;
+    post( [this, count](){sim.set_threads(count);} );
+    renderer.set_threads(count);
+}
+
+void Gravity_Draw::set_density_bodies(int bodies) {
+
+    // only the ui thread draws, so the renderer can be changed directly
+    renderer.density_bodies = bodies;
+    wake();
+}
@@ -1,121 +1,258 @@
-#ifndef GRAVITY_WINDOW_H
-#define GRAVITY_WINDOW_H
-
-#include <gtkmm/window.h>
-#include <gtkmm/box.h>
-#include <gtkmm/grid.h>
-#include <gtkmm/label.h>
-#include <gtkmm/button.h>
-#include <gtkmm/checkbutton.h>
-#include <gtkmm/scale.h>
-#include <gtkmm/drawingarea.h>
-#include <gtkmm/adjustment.h>
-#include <gdk/gdk.h>
-#include <vector>
-#include <deque>
-#include <array>
-
-
-struct Mouse_Info {
-
-    double  x;          // x coordinate of mouse pointer
-    double  y;          // y coordinate of mouse pointer
-    double  click_x;    // x coordinate of right click  
-    double  click_y;    // y coordinate of right click
-    bool    clicked;    // true if mouse is right clicked
-    double  click_time; // time for which right click has been held
-};
-
-struct Body {
-
-    std::array<double, 2> pos;
-    std::array<double, 2> vel;
-    double mass;
-    std::deque<std::array<double, 2>> trail;
-};
-
-class Gravity_Draw: public Gtk::DrawingArea {
-
-public:
-    Gravity_Draw(); // constructor
-
-    // event function overrides
-    bool on_draw(const Cairo::RefPtr<Cairo::Context>& draw_context) override;
-    bool on_scroll_event(GdkEventScroll * scroll_event) override;
-    bool on_motion_notify_event(GdkEventMotion * motion_event) override;
-    bool on_button_press_event(GdkEventButton * button_event) override;
-    bool on_button_release_event(GdkEventButton * button_event) override;
-    bool on_timeout();
-
-    void framerate_changed(); // called when framerate is changed
-    void gravity();           // calculates gravitational forces between bodies
-    void join();              // joins bodies together if they collide
-    void store_trails();      // stores data used to draw trails
-    void reset();             // resets members to initial values
-    void clear();             // clears bodies from simulation
-
-    bool paused;      // true when simulation is paused
-    int traillength;  // length of trails behind bodies
-    double framerate; // target framerate of simulation
-    double timescale; // scaling of simulation time
-
-protected:
-    std::vector<Body>                   bodies;             // vector of bodies
-    std::vector<double>                 centre;             // coordinates of origin - used for drawing
-    std::vector<double>                 background;         // colour of background
-    double                              zoom;               // level of zoom
-    double                              prev_zoom;          // previous level of zoom
-    Mouse_Info                          mouse_info;         // stores info about mouse eg current position and click position
-    sigc::connection                    timeout_connection; // connection to timeout event used for scheduling screen refreshes
-
-};
-
-
-class Gravity_Window: public Gtk::Window {
-
-public:
-    Gravity_Window();           // constructor
-
-    void reset_sim();           // function attached to reset button
-    void toggle_pause();        // function attached to pause button
-    void traillength_changed(); // function attached to trail length slider
-    void framerate_changed();   // function attached to framerate slider
-    void timescale_changed();   // function attached to timescale slider
-
-protected:
-    Gtk::Box      main_box;     // main box
-    Gtk::Box      side_box;     // side box
-
-    Gtk::Label    title;        // main title
-    Gtk::Button   reset;        // button to reset simulation
-    Gtk::Button   clear;        // button to clear bodies
-    Gtk::Button   pause;        // button to pause simulation
-
-    Gtk::Box      trail_box;    // box to hold trail length labels
-    Gtk::Label    traillabel;   // label for trail length slider
-    Gtk::Label    trailspacer;  // spacer for trail length labels
-    Gtk::Label    trailvalue;   // label for value of trail length
-    Gtk::Scale    traillength;  // controls trail length
-
-    Gtk::Box      frame_box;    // box to hold framerate labels
-    Gtk::Label    framelabel;   // label for framerate slider
-    Gtk::Label    framespacer;  // spacer for framerate labels
-    Gtk::Label    framevalue;   // label for value of framerate
-    Gtk::Scale    framerate;    // controls simulation framerate
-
-    Gtk::Box      time_box;     // box to hold time scale labels
-    Gtk::Label    timelabel;    // label for time scale slider
-    Gtk::Label    timespacer;   // spacer for time scale labels
-    Gtk::Label    timevalue;    // label for value of time scale
-    Gtk::Scale    timescale;    // controls simulation time scaling
-
-    Gtk::Label    instructions; // label containing instructions for using the program
-
-    Gravity_Draw  gravity_draw; // draws and calculates gravity simulation
-
-    Glib::RefPtr<Gtk::Adjustment> traillength_adjust_ptr; // pointer to adjustment for trailength slider
-    Glib::RefPtr<Gtk::Adjustment> framerate_adjust_ptr;   // pointer to adjustment for framerate slider
-    Glib::RefPtr<Gtk::Adjustment> timescale_adjust_ptr;   // pointer to adjustment for timescale slider
-};
-
+#ifndef GRAVITY_WINDOW_H
+#define GRAVITY_WINDOW_H
+
+#include <gtkmm/window.h>
+#include <gtkmm/box.h>
+#include <gtkmm/grid.h>
+#include <gtkmm/label.h>
+#include <gtkmm/button.h>
+#include <gtkmm/checkbutton.h>
+#include <gtkmm/scale.h>
+#include <gtkmm/comboboxtext.h>
+#include <gtkmm/drawingarea.h>
+#include <gtkmm/filechooserdialog.h>
+#include <gtkmm/adjustment.h>
+#include <gdkmm/frameclock.h>
+#include <glibmm/dispatcher.h>
+#include <gdk/gdk.h>
+#include <vector>
+#include <deque>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include "simulation.h"
+#include "snapshot_file.h"
+#include "trajectory.h"
+#include "draw_snapshot.h"
+#include "renderer.h"
+#include "triple_buffer.h"
+
+
+struct Mouse_Info {
+
+    double  x;          // x coordinate of mouse pointer
+    double  y;          // y coordinate of mouse pointer
+    double  click_x;    // x coordinate of right click  
+    double  click_y;    // y coordinate of right click
+    bool    clicked;    // true if mouse is right clicked
+    double  click_time; // time for which right click has been held
+};
+
+class Gravity_Draw: public Gtk::DrawingArea {
+
+public:
+    Gravity_Draw();  // constructor
+    ~Gravity_Draw(); // destructor - stops the stepper thread
+
+    // event function overrides
+    bool on_draw(const Cairo::RefPtr<Cairo::Context>& draw_context) override;
+    bool on_scroll_event(GdkEventScroll * scroll_event) override;
+    bool on_motion_notify_event(GdkEventMotion * motion_event) override;
+    bool on_button_press_event(GdkEventButton * button_event) override;
+    bool on_button_release_event(GdkEventButton * button_event) override;
+    bool on_tick(const Glib::RefPtr<Gdk::FrameClock> &clock);
+
+    void wake();              // called when anything drawn has changed, so that the next frame is drawn
+    void pause_changed();     // called when paused is changed
+    void framerate_changed(); // called when framerate is changed
+    void threads_changed();   // called when the number of threads is changed
+    void set_density_bodies(int bodies); // draws bodies as a density splat from this many on, 0 for never
+    void reset();             // resets members to initial values
+    void clear();             // clears bodies from simulation
+    void save(const std::string &path);                 // writes a snapshot of the bodies and view to path
+    void restore(std::shared_ptr<Snapshot_File> file);  // replaces the bodies and view with an opened snapshot
+
+    void start_recording(const std::string &path);      // streams every step to a trajectory file
+    void stop_recording();
+    bool start_replay(const std::string &path);         // shows a recorded trajectory instead of simulating
+    void stop_replay();                                 // goes back to the bodies from before the replay
+    void seek(long frame);                              // jumps to a frame of the replay
+    void show_profile(bool show);                       // starts timing each stage and shows the percentiles over the bodies
+    bool export_profile(const std::string &path);       // writes the profiled samples as csv
+
+    // settings are written by the ui thread and read by the stepper thread
+    std::atomic<bool>         paused;       // true when simulation is paused
+    std::atomic<int>          traillength;  // length of trails behind bodies
+    std::atomic<double>       framerate;    // number of times per second the simulation is advanced
+    std::atomic<double>       timescale;    // scaling of simulation time
+    std::atomic<double>       dt;           // simulated time advanced by each substep
+    std::atomic<Force_Method> force_method; // method used to calculate gravitational forces
+    std::atomic<double>       theta;        // opening angle of the Barnes-Hut tree
+    std::atomic<int>          mesh_size;    // nodes along each side of the particle mesh
+    int threads;                            // number of threads used for force evaluation and collision detection
+
+    // written by the stepper thread and read by the ui thread
+    std::atomic<long>         replay_frames;   // number of frames in the replay, 0 when not replaying
+    std::atomic<long>         replay_position; // frame of the replay shown last
+
+protected:
+    // run on the stepper thread
+    void step_loop();         // advances the simulation by the real time passed, framerate times a second, until stopping is set
+    bool run_commands();      // runs the changes to the bodies queued by the ui thread - false if there were none
+    void publish();           // copies the bodies into a snapshot for on_draw
+    bool replay_step();       // shows the next frame of the replay - false once the replay has ended
+
+    // queues a change to the bodies to be run on the stepper thread before its next step
+    void post(std::function<void()> command);
+
+    // run on the ui thread
+    void invalidate_trails(); // redraws the trail cache from whole trails once they next arrive
+    void wake_stepper();      // makes the stepper thread run a pass now, even if it is idle
+
+    // owned by the stepper thread once it has started
+    Simulation                          sim;                // bodies and the physics that steps them
+    long                                published_step;     // value of sim.trail_steps in the last published snapshot
+    Trajectory_Recorder                 recorder;           // writes each step while recording
+    std::shared_ptr<Trajectory_Reader>  replay;             // recorded trajectory being shown, if any
+    Trajectory_Frame                    replay_frame;       // frame of the replay being shown
+    long                                replay_next;        // frame of the replay to show next
+    Body_Store                          before_replay;      // bodies to go back to when the replay stops
+
+    // shared between the threads
+    Triple_Buffer<Draw_Snapshot>        snapshots;          // latest state published for drawing
+    Profiler                            profiler;           // times stages of both threads while enabled
+    std::vector<std::function<void()>>  commands;           // changes to the bodies waiting to be run
+    std::mutex                          command_lock;       // guards commands and stopping
+    std::condition_variable             command_wake;       // wakes the stepper early for commands, stopping or wake_stepper
+    bool                                stopping;           // tells the stepper thread to exit
+    bool                                stepper_woken;      // set by wake_stepper until the stepper runs a pass
+    Glib::Dispatcher                    published_signal;   // emitted by the stepper after each publish, handled on the ui thread
+    std::atomic<long>                   steps_done;         // copy of sim.steps readable from the ui thread
+    std::atomic<bool>                   full_trails_wanted; // asks for whole trails in the next snapshot
+    std::thread                         stepper;            // runs the simulation independently of drawing
+
+    // owned by the ui thread
+    std::vector<double>                 centre;             // coordinates of origin - used for drawing
+    std::vector<double>                 background;         // colour of background
+    double                              zoom;               // level of zoom
+    double                              prev_zoom;          // previous level of zoom
+    Mouse_Info                          mouse_info;         // stores info about mouse eg current position and click position
+    bool                                ticking;            // true while the frame clock calls on_tick
+    bool                                dirty;              // true if the next frame has to be drawn
+    gint64                              frame_time;         // frame clock time of the last tick in microseconds, 0 after waking
+    gint64                              change_time;        // frame clock time of the last tick that drew
+    std::chrono::steady_clock::time_point rate_time;        // start of the interval the rates are measured over
+    long                                rate_steps;         // steps_done at rate_time
+    int                                 rate_draws;         // frames drawn since rate_time
+    double                              sim_rate;           // simulation steps per second
+    double                              ui_rate;            // frames drawn per second
+    Renderer                            renderer;           // draws snapshots and caches the trails
+
+};
+
+
+class Gravity_Window: public Gtk::Window {
+
+public:
+    Gravity_Window();           // constructor
+
+    void reset_sim();           // function attached to reset button
+    void toggle_pause();        // function attached to pause button
+    void traillength_changed(); // function attached to trail length slider
+    void framerate_changed();   // function attached to framerate slider
+    void timescale_changed();   // function attached to timescale slider
+    void dt_changed();          // function attached to step size slider
+    void method_changed();      // function attached to force method selector
+    void theta_changed();       // function attached to theta slider
+    void mesh_changed();        // function attached to mesh size slider
+    void threads_changed();     // function attached to threads slider
+    void density_changed();     // function attached to density slider
+    void save_clicked();        // function attached to save button
+    void load_clicked();        // function attached to load button
+    void record_clicked();      // function attached to record button
+    void replay_clicked();      // function attached to replay button
+    void seek_changed();        // function attached to replay position slider
+    void profile_toggled();     // function attached to profile check button
+    void export_clicked();      // function attached to export profile button
+    bool update_seek();         // moves the replay position slider along with the replay
+    bool load_scene(const std::string &path); // loads a snapshot and sets the sliders to its settings
+
+protected:
+    Gtk::Box      main_box;     // main box
+    Gtk::Box      side_box;     // side box
+
+    Gtk::Label    title;        // main title
+    Gtk::Button   reset;        // button to reset simulation
+    Gtk::Button   clear;        // button to clear bodies
+    Gtk::Button   pause;        // button to pause simulation
+    Gtk::Button   save;         // button to save a snapshot
+    Gtk::Button   load;         // button to load a snapshot
+    Gtk::Button   record;       // button to start and stop recording a trajectory
+    Gtk::Button   replay;       // button to start and stop replaying a trajectory
+    Gtk::Scale    replay_seek;  // position in the replay
+    bool          recording;    // true while a trajectory is being recorded
+    bool          seek_moving;  // true while update_seek moves replay_seek, so it isn't taken as a seek
+    Gtk::CheckButton profile;   // shows the profiling overlay
+    Gtk::Button   export_profile; // button to write the profiled samples to a csv file
+
+    Gtk::Box      trail_box;    // box to hold trail length labels
+    Gtk::Label    traillabel;   // label for trail length slider
+    Gtk::Label    trailspacer;  // spacer for trail length labels
+    Gtk::Label    trailvalue;   // label for value of trail length
+    Gtk::Scale    traillength;  // controls trail length
+
+    Gtk::Box      frame_box;    // box to hold framerate labels
+    Gtk::Label    framelabel;   // label for framerate slider
+    Gtk::Label    framespacer;  // spacer for framerate labels
+    Gtk::Label    framevalue;   // label for value of framerate
+    Gtk::Scale    framerate;    // controls simulation framerate
+
+    Gtk::Box      time_box;     // box to hold time scale labels
+    Gtk::Label    timelabel;    // label for time scale slider
+    Gtk::Label    timespacer;   // spacer for time scale labels
+    Gtk::Label    timevalue;    // label for value of time scale
+    Gtk::Scale    timescale;    // controls simulation time scaling
+
+    Gtk::Box      dt_box;       // box to hold step size labels
+    Gtk::Label    dtlabel;      // label for step size slider
+    Gtk::Label    dtspacer;     // spacer for step size labels
+    Gtk::Label    dtvalue;      // label for value of step size
+    Gtk::Scale    dt;           // controls the timestep of the integrator
+
+    Gtk::ComboBoxText method;   // selects the force method
+
+    Gtk::Box      theta_box;    // box to hold theta labels
+    Gtk::Label    thetalabel;   // label for theta slider
+    Gtk::Label    thetaspacer;  // spacer for theta labels
+    Gtk::Label    thetavalue;   // label for value of theta
+    Gtk::Scale    theta;        // controls the Barnes-Hut opening angle
+
+    Gtk::Box      mesh_box;     // box to hold mesh size labels
+    Gtk::Label    meshlabel;    // label for mesh size slider
+    Gtk::Label    meshspacer;   // spacer for mesh size labels
+    Gtk::Label    meshvalue;    // label for value of mesh size
+    Gtk::Scale    mesh;         // controls the resolution of the particle mesh, in powers of 2
+
+    Gtk::Box      thread_box;   // box to hold thread count labels
+    Gtk::Label    threadlabel;  // label for thread count slider
+    Gtk::Label    threadspacer; // spacer for thread count labels
+    Gtk::Label    threadvalue;  // label for value of thread count
+    Gtk::Scale    threads;      // controls number of threads
+
+    Gtk::Box      density_box;  // box to hold density labels
+    Gtk::Label    densitylabel; // label for density slider
+    Gtk::Label    densityspacer; // spacer for density labels
+    Gtk::Label    densityvalue; // label for the body count bodies are splatted from
+    Gtk::Scale    density;      // controls the body count bodies are splatted from, in powers of 2
+
+    Gtk::Label    instructions; // label containing instructions for using the program
+
+    Gravity_Draw  gravity_draw; // draws and calculates gravity simulation
+
+    Glib::RefPtr<Gtk::Adjustment> traillength_adjust_ptr; // pointer to adjustment for trailength slider
+    Glib::RefPtr<Gtk::Adjustment> framerate_adjust_ptr;   // pointer to adjustment for framerate slider
+    Glib::RefPtr<Gtk::Adjustment> timescale_adjust_ptr;   // pointer to adjustment for timescale slider
+    Glib::RefPtr<Gtk::Adjustment> dt_adjust_ptr;          // pointer to adjustment for step size slider
+    Glib::RefPtr<Gtk::Adjustment> theta_adjust_ptr;       // pointer to adjustment for theta slider
+    Glib::RefPtr<Gtk::Adjustment> mesh_adjust_ptr;        // pointer to adjustment for mesh size slider
+    Glib::RefPtr<Gtk::Adjustment> threads_adjust_ptr;     // pointer to adjustment for threads slider
+    Glib::RefPtr<Gtk::Adjustment> density_adjust_ptr;     // pointer to adjustment for density slider
+    Glib::RefPtr<Gtk::Adjustment> seek_adjust_ptr;        // pointer to adjustment for replay position slider
+};
+
 #endif /* GRAVITY_WINDOW_H */
\ No newline at end of file
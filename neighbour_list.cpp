@@ -0,0 +1,221 @@
+#include "neighbour_list.h"
+#include <algorithm>
+#include <cmath>
+
+
+// number of bodies in each tile of rows handed to a thread while building the lists
+static const int list_tile = 128;
+
+uint32_t Neighbour_List::hash(int64_t cx, int64_t cy) const {
+
+    return (uint32_t) ((cx * 73856093) ^ (cy * 19349663)) & mask;
+}
+
+template<class Partner>
+void Neighbour_List::search(int i, const Body_Store &bodies, Partner partner) const {
+
+    int64_t  cx = std::floor(bodies.x[i]/width);
+    int64_t  cy = std::floor(bodies.y[i]/width);
+    uint32_t seen[9];
+    int      visited = 0;
+
+    for(int ox = -1; ox <= 1; ox++) {
+        for(int oy = -1; oy <= 1; oy++) {
+
+            // neighbouring cells can share a bucket - only search each bucket once
+            uint32_t b = hash(cx + ox, cy + oy);
+            if(std::find(seen, seen + visited, b) != seen + visited) { continue; }
+            seen[visited++] = b;
+
+            for(int k = start[b]; k < start[b+1]; k++) { partner(order[k]); }
+        }
+    }
+}
+
+bool Neighbour_List::valid(const Body_Store &bodies, double cutoff, double skin) const {
+
+    int n = bodies.size();
+
+    if(cutoff != this->cutoff || skin != this->skin || n != (int) built_x.size()) { return false; }
+
+    // merging, adding or removing bodies renumbers them, which their handles give away
+    double limit = 0.25 * skin * skin;
+
+    for(int i = 0; i < n; i++) {
+
+        if(bodies.handle[i] != built_handle[i]) { return false; }
+
+        double dx = bodies.x[i] - built_x[i];
+        double dy = bodies.y[i] - built_y[i];
+
+        if(dx*dx + dy*dy > limit) { return false; }
+    }
+
+    return true;
+}
+
+void Neighbour_List::update(const Body_Store &bodies, double cutoff, double skin, Thread_Pool &pool) {
+
+    if(listed && valid(bodies, cutoff, skin)) { return; }
+
+    this->cutoff = cutoff;
+    this->skin   = skin;
+    width        = cutoff + skin;
+    listed       = false;
+
+    build_cells(bodies);
+    if(skin > 0 && !crowded()) { build_lists(bodies, pool); }
+
+    builds++;
+}
+
+void Neighbour_List::refresh(const Body_Store &bodies, double cutoff, double skin) {
+
+    if(listed && valid(bodies, cutoff, skin)) { return; }
+
+    this->cutoff = cutoff;
+    this->skin   = skin;
+    width        = cutoff + skin;
+    listed       = false;
+
+    build_cells(bodies);
+
+    builds++;
+}
+
+void Neighbour_List::build_cells(const Body_Store &bodies) {
+
+    int n = bodies.size();
+
+    // at least twice as many buckets as bodies keeps unrelated cells from sharing buckets
+    uint32_t buckets = 1;
+    while(buckets < 2*(uint32_t)n) { buckets *= 2; }
+    mask = buckets - 1;
+
+    // counting sort the bodies by bucket
+    bucket.resize(n);
+    start.assign(buckets + 1, 0);
+    order.resize(n);
+
+    for(int i = 0; i < n; i++) {
+
+        bucket[i] = hash( (int64_t) std::floor(bodies.x[i]/width), (int64_t) std::floor(bodies.y[i]/width) );
+        start[bucket[i] + 1]++;
+    }
+
+    // a body sharing its bucket with k others tests about 9k bodies across the 9 cells
+    double shared = 0;
+    for(uint32_t b = 1; b <= buckets; b++) { shared += (double) start[b] * start[b]; }
+    candidates = n > 0 ? 9 * shared / n : 0;
+
+    for(uint32_t b = 0; b < buckets; b++) { start[b+1] += start[b]; }
+
+    // fill each bucket in increasing body order, using the starts of the following buckets as cursors
+    for(int i = 0; i < n; i++) { order[start[bucket[i]]++] = i; }
+    for(uint32_t b = buckets; b > 0; b--) { start[b] = start[b-1]; }
+    start[0] = 0;
+}
+
+void Neighbour_List::build_lists(const Body_Store &bodies, Thread_Pool &pool) {
+
+    int    n     = bodies.size();
+    int    tiles = (n + list_tile - 1) / list_tile;
+    double w2    = width * width;
+
+    // count each body's partners, then fill the lists in a second pass once their starts are known
+    list_start.assign(n + 1, 0);
+
+    pool.run(tiles, [&](int t, int) {
+
+        int end = std::min((t+1) * list_tile, n);
+
+        for(int i = t * list_tile; i < end; i++) {
+
+            long count = 0;
+
+            search(i, bodies, [&](int j) {
+
+                double dx = bodies.x[j] - bodies.x[i];
+                double dy = bodies.y[j] - bodies.y[i];
+
+                if(j != i && dx*dx + dy*dy <= w2) { count++; }
+            });
+
+            list_start[i+1] = count;
+        }
+    });
+
+    for(int i = 0; i < n; i++) { list_start[i+1] += list_start[i]; }
+
+    if(list_start[n] > max_list_entries) { return; }
+
+    list.resize(list_start[n]);
+
+    pool.run(tiles, [&](int t, int) {
+
+        int end = std::min((t+1) * list_tile, n);
+
+        for(int i = t * list_tile; i < end; i++) {
+
+            long next = list_start[i];
+
+            search(i, bodies, [&](int j) {
+
+                double dx = bodies.x[j] - bodies.x[i];
+                double dy = bodies.y[j] - bodies.y[i];
+
+                if(j != i && dx*dx + dy*dy <= w2) { list[next++] = j; }
+            });
+        }
+    });
+
+    built_x      = bodies.x;
+    built_y      = bodies.y;
+    built_handle = bodies.handle;
+    listed       = true;
+}
+
+std::array<double, 2> Neighbour_List::acceleration(int i, const Body_Store &bodies, double softening,
+                                                   long *interactions) const {
+
+    double ax = 0;
+    double ay = 0;
+    long   tested = 0;
+
+    double x  = bodies.x[i];
+    double y  = bodies.y[i];
+    double c2 = cutoff * cutoff;
+    double e2 = softening * softening;
+
+    // the same test and the same arithmetic for each pair as the direct sum, with the square root
+    // only taken for the pairs inside the cutoff
+    auto partner = [&](int j) {
+
+        double dx = bodies.x[j] - x;
+        double dy = bodies.y[j] - y;
+        double d2 = dx*dx + dy*dy;
+
+        tested++;
+
+        if(d2 == 0 || d2 > c2) { return; }
+
+        double e = d2 + e2;
+        double s = 100 * bodies.m[j] / (e * std::sqrt(e));
+
+        ax += s*dx;
+        ay += s*dy;
+    };
+
+    if(listed) {
+
+        for(long k = list_start[i]; k < list_start[i+1]; k++) { partner(list[k]); }
+    }
+    else {
+
+        search(i, bodies, partner);
+    }
+
+    if(interactions) { *interactions += tested; }
+
+    return {ax, ay};
+}
@@ -0,0 +1,70 @@
+#ifndef NEIGHBOUR_LIST_H
+#define NEIGHBOUR_LIST_H
+
+#include "body.h"
+#include "thread_pool.h"
+#include <vector>
+#include <array>
+#include <cstdint>
+
+
+// finds the partners of each body within a cutoff without testing every pair - bodies are hashed into
+// cells at least as wide as the cutoff, so every partner is in a body's own or one of the 8 neighbouring
+// cells, and the cost is O(N * neighbours). Given a skin, each body also keeps a list of the bodies
+// within cutoff + skin, which is only rebuilt once some body has moved half the skin, since no pair
+// can have come inside the cutoff from outside the lists before then (Verlet lists). Either way the
+// pairs summed are exactly those the direct sum sums, only in a different order
+class Neighbour_List {
+
+public:
+    // hashes the bodies again, and rebuilds the lists if skin > 0, unless the lists are still valid
+    void update(const Body_Store &bodies, double cutoff, double skin, Thread_Pool &pool);
+
+    // as update, but if the lists can't be reused only the cells are hashed again, which costs O(N)
+    // rather than O(N * neighbours) - for when only a few bodies are wanted
+    void refresh(const Body_Store &bodies, double cutoff, double skin);
+
+    // acceleration on bodies[i] from every body within the cutoff of the last update, with distances
+    // softened over softening - adds the number of partners tested to interactions if it is given
+    std::array<double, 2> acceleration(int i, const Body_Store &bodies, double softening,
+                                       long *interactions = nullptr) const;
+
+    // true if the last update found the cells so full that each body would test more than an eighth
+    // of all the bodies - the vectorised direct sum is then faster for the same pairs
+    bool crowded() const { return candidates * 8 > (double) bucket.size(); }
+
+    long builds = 0;                 // number of times the cells have been built
+
+protected:
+    uint32_t hash(int64_t cx, int64_t cy) const;
+    bool     valid(const Body_Store &bodies, double cutoff, double skin) const; // true if the lists can be reused
+    void     build_cells(const Body_Store &bodies);
+    void     build_lists(const Body_Store &bodies, Thread_Pool &pool);
+
+    // calls partner(j) for each body in the cells around body i, each at most once
+    template<class Partner>
+    void     search(int i, const Body_Store &bodies, Partner partner) const;
+
+    // lists bigger than this are dropped in favour of searching the cells at every update, since
+    // bodies that crowded share most of their partners with the direct sum anyway
+    static const long max_list_entries = 1L << 26;
+
+    double                cutoff = 0;       // cutoff of the last update
+    double                skin   = 0;       // skin of the last update
+    double                width  = 0;       // width of a cell, cutoff + skin
+    bool                  listed = false;   // true if the lists were built by the last update
+    double                candidates = 0;   // estimate of the bodies each body tests in the cells
+
+    uint32_t              mask;             // number of buckets - 1, a power of 2 minus 1
+    std::vector<uint32_t> bucket;           // bucket of each body
+    std::vector<int>      start;            // bodies in bucket b are order[start[b] .. start[b+1]]
+    std::vector<int>      order;            // bodies sorted by bucket
+
+    std::vector<long>     list_start;       // partners of body i are list[list_start[i] .. list_start[i+1]]
+    std::vector<int>      list;             // partners within cutoff + skin of each body
+    std::vector<double>   built_x;          // positions of the bodies when the lists were built
+    std::vector<double>   built_y;
+    std::vector<Body_Handle> built_handle;  // handle of each body when built
+};
+
+#endif /* NEIGHBOUR_LIST_H */
@@ -0,0 +1,342 @@
+#include "particle_mesh.h"
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+
+typedef std::complex<double> Complex;
+
+// columns transformed together by one task, so that gathering them reads whole cache lines
+static const int column_block = 8;
+
+// written out so that the multiplications in the transform aren't checked for infinities and NaNs
+static inline Complex multiply(Complex a, Complex b) {
+
+    return Complex(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+}
+
+// in place radix 2 transform of n points, n a power of 2 - the inverse is not divided by n
+static void fft(Complex *a, int n, const Complex *twiddle, bool inverse) {
+
+    // put the points in bit reversed order
+    for(int i = 1, j = 0; i < n; i++) {
+
+        int bit = n >> 1;
+        for(; j & bit; bit >>= 1) { j ^= bit; }
+        j ^= bit;
+
+        if(i < j) { std::swap(a[i], a[j]); }
+    }
+
+    // then combine pairs of transforms of doubling length
+    for(int length = 2; length <= n; length <<= 1) {
+
+        int half   = length / 2;
+        int stride = n / length;
+
+        for(int start = 0; start < n; start += length) {
+            for(int k = 0; k < half; k++) {
+
+                Complex w = inverse ? std::conj(twiddle[k*stride]) : twiddle[k*stride];
+                Complex u = a[start + k];
+                Complex v = multiply(a[start + k + half], w);
+
+                a[start + k]        = u + v;
+                a[start + k + half] = u - v;
+            }
+        }
+    }
+}
+
+void Particle_Mesh::fft_rows(std::vector<Complex> &grid, int first, int count, bool inverse, Thread_Pool &pool) {
+
+    pool.run(count, [&](int r, int) {
+
+        fft(grid.data() + (size_t) (first + r) * padded, padded, twiddle.data(), inverse);
+    });
+}
+
+void Particle_Mesh::fft_columns(std::vector<Complex> &grid, bool inverse, Thread_Pool &pool) {
+
+    pool.run(padded / column_block, [&](int t, int worker) {
+
+        std::vector<Complex> &columns = scratch[worker];
+        columns.resize((size_t) column_block * padded);
+
+        int first = t * column_block;
+
+        for(int r = 0; r < padded; r++) {
+            for(int c = 0; c < column_block; c++) { columns[(size_t) c*padded + r] = grid[(size_t) r*padded + first + c]; }
+        }
+
+        for(int c = 0; c < column_block; c++) { fft(columns.data() + (size_t) c*padded, padded, twiddle.data(), inverse); }
+
+        for(int r = 0; r < padded; r++) {
+            for(int c = 0; c < column_block; c++) { grid[(size_t) r*padded + first + c] = columns[(size_t) c*padded + r]; }
+        }
+    });
+}
+
+void Particle_Mesh::build_kernel(Thread_Pool &pool) {
+
+    twiddle.resize(padded / 2);
+    for(int k = 0; k < padded / 2; k++) { twiddle[k] = std::polar(1.0, -2 * M_PI * k / padded); }
+
+    // the acceleration at a node from a unit mass d nodes away, -100 d h / r^3 for the whole force or
+    // the same scaled by the long range fraction of it - offsets past size wrap around to negative,
+    // and the 1/padded^2 of the inverse transform is folded in here
+    kernel.resize((size_t) padded * padded);
+
+    const double root_pi = std::sqrt(M_PI);
+    double       scale   = 1.0 / ((double) padded * padded);
+
+    pool.run(padded, [&](int a, int) {
+
+        int dy = a < size ? a : a - padded;
+
+        for(int b = 0; b < padded; b++) {
+
+            int    dx = b < size ? b : b - padded;
+            double r  = h * std::sqrt((double) dx*dx + (double) dy*dy);
+
+            if(r == 0 || r > cutoff) {
+
+                kernel[(size_t) a*padded + b] = 0;
+                continue;
+            }
+
+            double g = 100 / (r*r*r);
+
+            if(split) {
+
+                double u = r / (2*rs);
+                g       *= std::erf(u) - r * std::exp(-u*u) / (root_pi * rs);
+            }
+
+            kernel[(size_t) a*padded + b] = Complex(-dx*h*g, -dy*h*g) * scale;
+        }
+    });
+
+    fft_rows(kernel, 0, padded, false, pool);
+    fft_columns(kernel, false, pool);
+}
+
+void Particle_Mesh::solve(const Body_Store &bodies, int size, bool short_range, double cutoff, Thread_Pool &pool) {
+
+    int n = bodies.size();
+    if(n == 0) { return; }
+
+    int nodes = 8;
+    while(nodes < size) { nodes *= 2; }
+
+    double xmin = bodies.x[0], xmax = bodies.x[0];
+    double ymin = bodies.y[0], ymax = bodies.y[0];
+
+    for(int i = 1; i < n; i++) {
+
+        xmin = std::min(xmin, bodies.x[i]);
+        xmax = std::max(xmax, bodies.x[i]);
+        ymin = std::min(ymin, bodies.y[i]);
+        ymax = std::max(ymax, bodies.y[i]);
+    }
+
+    // the spacing has to fit the bodies inside the grid with a node to spare at each edge - it is kept
+    // until the bodies outgrow it or shrink to half of it, so the kernel is rarely transformed again
+    double needed = std::max(std::max(xmax - xmin, ymax - ymin) / (nodes - 3), 1e-9);
+
+    scratch.resize(pool.size());
+
+    if(nodes != this->size || short_range != split || cutoff != this->cutoff || h < needed || h > 2*needed) {
+
+        this->size   = nodes;
+        this->cutoff = cutoff;
+        padded       = 2 * nodes;
+        split        = short_range;
+        h            = 1.25 * needed;
+        rs           = 1.25 * h;
+        reach        = std::min(4.5 * rs, cutoff);
+
+        build_kernel(pool);
+    }
+
+    x0 = 0.5 * (xmin + xmax) - 0.5 * h * (nodes - 1);
+    y0 = 0.5 * (ymin + ymax) - 0.5 * h * (nodes - 1);
+
+    // share the mass of each body between its 4 nodes, each chunk of bodies into a grid of its own
+    chunk_mass.resize(mesh_chunks);
+
+    pool.run(mesh_chunks, [&](int c, int) {
+
+        std::vector<double> &mass = chunk_mass[c];
+        mass.assign((size_t) nodes * nodes, 0);
+
+        int begin = (long) n * c / mesh_chunks;
+        int end   = (long) n * (c+1) / mesh_chunks;
+
+        for(int i = begin; i < end; i++) {
+
+            double u  = (bodies.x[i] - x0) / h;
+            double v  = (bodies.y[i] - y0) / h;
+            int    ix = u;
+            int    iy = v;
+            double fx = u - ix;
+            double fy = v - iy;
+            double m  = bodies.m[i];
+            size_t k  = (size_t) iy*nodes + ix;
+
+            mass[k]           += m * (1-fx) * (1-fy);
+            mass[k + 1]       += m * fx     * (1-fy);
+            mass[k + nodes]   += m * (1-fx) * fy;
+            mass[k + nodes+1] += m * fx     * fy;
+        }
+    });
+
+    // sum the chunks in order into the corner of the padded grid, leaving the rest empty
+    field.resize((size_t) padded * padded);
+
+    pool.run(padded, [&](int r, int) {
+
+        Complex *row = field.data() + (size_t) r*padded;
+        std::fill(row, row + padded, Complex(0));
+
+        if(r >= nodes) { return; }
+
+        for(int c = 0; c < nodes; c++) {
+
+            double m = 0;
+            for(int k = 0; k < mesh_chunks; k++) { m += chunk_mass[k][(size_t) r*nodes + c]; }
+            row[c] = m;
+        }
+    });
+
+    // convolve with the kernel - the empty rows stay empty in the first pass, and only the rows of the
+    // corner are needed from the last, whose real and imaginary parts are the x and y accelerations
+    fft_rows(field, 0, nodes, false, pool);
+    fft_columns(field, false, pool);
+
+    pool.run(padded, [&](int r, int) {
+
+        for(size_t k = (size_t) r*padded; k < (size_t) (r+1)*padded; k++) { field[k] = multiply(field[k], kernel[k]); }
+    });
+
+    fft_columns(field, true, pool);
+    fft_rows(field, 0, nodes, true, pool);
+
+    gx.resize((size_t) nodes * nodes);
+    gy.resize((size_t) nodes * nodes);
+
+    pool.run(nodes, [&](int r, int) {
+
+        for(int c = 0; c < nodes; c++) {
+
+            gx[(size_t) r*nodes + c] = field[(size_t) r*padded + c].real();
+            gy[(size_t) r*nodes + c] = field[(size_t) r*padded + c].imag();
+        }
+    });
+
+    if(split) { build_chains(bodies); }
+}
+
+void Particle_Mesh::update(const Body_Store &bodies, int size, bool short_range, double cutoff, Thread_Pool &pool) {
+
+    int nodes = 8;
+    while(nodes < size) { nodes *= 2; }
+
+    if(nodes != this->size || short_range != split || cutoff != this->cutoff) {
+
+        solve(bodies, size, short_range, cutoff, pool);
+    }
+    else if(split) {
+
+        build_chains(bodies);
+    }
+}
+
+void Particle_Mesh::build_chains(const Body_Store &bodies) {
+
+    int n = bodies.size();
+
+    // cells at least as wide as the reach of the short range force, so only neighbouring cells are searched
+    chain_size = (int) ((size - 1) * h / reach) + 1;
+
+    chain_cell.resize(n);
+    chain_start.assign((size_t) chain_size * chain_size + 1, 0);
+
+    for(int i = 0; i < n; i++) {
+
+        int cx = std::min(std::max((bodies.x[i] - x0) / reach, 0.0), chain_size - 1.0);
+        int cy = std::min(std::max((bodies.y[i] - y0) / reach, 0.0), chain_size - 1.0);
+
+        chain_cell[i] = cy * chain_size + cx;
+        chain_start[chain_cell[i] + 1]++;
+    }
+
+    for(size_t c = 1; c < chain_start.size(); c++) { chain_start[c] += chain_start[c-1]; }
+
+    // counting sort, which keeps the bodies of each cell in index order
+    chain_order.resize(n);
+    std::vector<int> fill(chain_start.begin(), chain_start.end() - 1);
+
+    for(int i = 0; i < n; i++) { chain_order[fill[chain_cell[i]]++] = i; }
+}
+
+std::array<double, 2> Particle_Mesh::acceleration(int i, const Body_Store &bodies, long *interactions) const {
+
+    // take the acceleration of the 4 nodes with the weights the mass was shared out with
+    double u  = std::min(std::max((bodies.x[i] - x0) / h, 0.0), size - 1.001);
+    double v  = std::min(std::max((bodies.y[i] - y0) / h, 0.0), size - 1.001);
+    int    ix = u;
+    int    iy = v;
+    double fx = u - ix;
+    double fy = v - iy;
+    size_t k  = (size_t) iy*size + ix;
+
+    double w00 = (1-fx) * (1-fy);
+    double w10 = fx     * (1-fy);
+    double w01 = (1-fx) * fy;
+    double w11 = fx     * fy;
+
+    double ax = w00*gx[k] + w10*gx[k+1] + w01*gx[k+size] + w11*gx[k+size+1];
+    double ay = w00*gy[k] + w10*gy[k+1] + w01*gy[k+size] + w11*gy[k+size+1];
+
+    long summed = 4;
+
+    // add the short range remainder from the bodies in the neighbouring cells
+    if(split) {
+
+        const double root_pi = std::sqrt(M_PI);
+
+        int cx = chain_cell[i] % chain_size;
+        int cy = chain_cell[i] / chain_size;
+
+        for(int ny = std::max(cy-1, 0); ny <= std::min(cy+1, chain_size-1); ny++) {
+            for(int nx = std::max(cx-1, 0); nx <= std::min(cx+1, chain_size-1); nx++) {
+
+                int c = ny * chain_size + nx;
+
+                for(int s = chain_start[c]; s < chain_start[c+1]; s++) {
+
+                    int    j  = chain_order[s];
+                    double dx = bodies.x[j] - bodies.x[i];
+                    double dy = bodies.y[j] - bodies.y[i];
+                    double d2 = dx*dx + dy*dy;
+
+                    if(d2 == 0 || d2 > reach*reach) { continue; }
+
+                    double r  = std::sqrt(d2);
+                    double w  = r / (2*rs);
+                    double g  = 100 * bodies.m[j] / (d2*r) * (std::erfc(w) + r * std::exp(-w*w) / (root_pi * rs));
+
+                    ax += g * dx;
+                    ay += g * dy;
+                    summed++;
+                }
+            }
+        }
+    }
+
+    if(interactions) { *interactions += summed; }
+
+    return {ax, ay};
+}
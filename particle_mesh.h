@@ -0,0 +1,73 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include "body.h"
+#include "thread_pool.h"
+#include <vector>
+#include <array>
+#include <complex>
+
+
+// number of private grids the bodies are deposited into before being summed - fixed rather than
+// one per thread so that the sums, and so the forces, don't depend on the number of threads
+const int mesh_chunks = 8;
+
+// finds forces on a grid rather than between bodies - the mass of each body is shared between the 4
+// nearest nodes (cloud-in-cell), the acceleration at every node is the convolution of the masses
+// with the force law, done as a product of FFTs on a grid padded to twice the size so that the
+// bodies don't feel periodic images, and bodies take the acceleration of their 4 nodes back with
+// the same weights. The cost is O(N + G^2 log G) for G nodes a side, whatever the clustering.
+//
+// Forces closer than a couple of nodes are smoothed out. With short_range set the mesh only carries
+// the long range part of the force, 100 m erf(r/2rs)/r^2 less its slope term with rs 1.25 nodes,
+// and the remainder is summed directly between bodies closer than 4.5 rs (P3M)
+class Particle_Mesh {
+
+public:
+    // deposits the bodies onto a size x size grid, size being a power of 2, and finds the acceleration
+    // at every node, ignoring pairs further apart than cutoff
+    void solve(const Body_Store &bodies, int size, bool short_range, double cutoff, Thread_Pool &pool);
+
+    // sorts the bodies into the cells the short range sum searches again after they have moved, keeping
+    // the grid of the last solve - bodies which have left the grid take the acceleration of its edge.
+    // Solves again instead if the last solve was for other settings, or there hasn't been one
+    void update(const Body_Store &bodies, int size, bool short_range, double cutoff, Thread_Pool &pool);
+
+    // acceleration on bodies[i] interpolated from the last solve, plus the short range sum if it was
+    // asked for - adds the number of nodes and bodies summed to interactions if it is given
+    std::array<double, 2> acceleration(int i, const Body_Store &bodies, long *interactions = nullptr) const;
+
+protected:
+    typedef std::complex<double> Complex;
+
+    void build_kernel(Thread_Pool &pool);   // transforms the force law for the current size, spacing and split
+    void build_chains(const Body_Store &bodies);  // sorts the bodies into cells as wide as the short range
+
+    // transforms rows [first, first + count) of a padded grid, or all of its columns
+    void fft_rows(std::vector<Complex> &grid, int first, int count, bool inverse, Thread_Pool &pool);
+    void fft_columns(std::vector<Complex> &grid, bool inverse, Thread_Pool &pool);
+
+    int                               size    = 0;     // nodes along each side of the grid
+    int                               padded  = 0;     // nodes along each side of the transformed grids, 2*size
+    double                            h       = 0;     // spacing of the nodes
+    double                            x0, y0;          // position of node 0, 0
+    double                            cutoff  = 0;     // distance beyond which pairs are ignored
+    bool                              split   = false; // true if the mesh only carries the long range force
+    double                            rs;              // scale of the split between long and short range
+    double                            reach;           // distance the short range force is summed to
+
+    std::vector<Complex>              twiddle;         // exp(-2 pi i k / padded) for k < padded/2
+    std::vector<Complex>              kernel;          // transform of the force law, x + i y, over padded^2
+    std::vector<Complex>              field;           // masses, then their transform, then the accelerations
+    std::vector<std::vector<double>>  chunk_mass;      // masses deposited by each chunk of bodies
+    std::vector<double>               gx;              // x acceleration at each node, row by row
+    std::vector<double>               gy;              // y acceleration at each node, row by row
+    std::vector<std::vector<Complex>> scratch;         // a block of columns for each thread
+
+    int                               chain_size;      // cells along each side of the chaining mesh
+    std::vector<int>                  chain_start;     // bodies in cell c are chain_order[chain_start[c] .. chain_start[c+1]]
+    std::vector<int>                  chain_order;     // bodies sorted by cell
+    std::vector<int>                  chain_cell;      // cell of each body
+};
+
+#endif /* PARTICLE_MESH_H */
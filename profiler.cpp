@@ -0,0 +1,120 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+
+const char *const profile_names[PROFILE_SERIES_COUNT] = {
+
+    "store_trails", "join", "gravity", "draw_background", "draw_trails", "draw_bodies", "draw",
+    "bodies", "interactions", "merges", "allocations"
+};
+
+std::atomic<long> allocation_count(0);
+
+// replacing the global operator new counts allocations made anywhere in the program - the other
+// forms of new and delete are left to the standard library, which builds them on these
+void *operator new(std::size_t size) {
+
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if(void *p = std::malloc(size ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+
+    std::free(p);
+}
+
+Profiler::Profiler() :
+    enabled(false) {
+
+    clear();
+}
+
+void Profiler::add(Profile_Series series, double value) {
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    Ring &ring = rings[series];
+    ring.values[ring.count % window] = value;
+    ring.count++;
+}
+
+Profiler::Summary Profiler::summary(Profile_Series series) const {
+
+    Summary summary;
+    std::vector<double> values;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        const Ring &ring = rings[series];
+        if(ring.count == 0) { return summary; }
+
+        int kept = std::min<long>(ring.count, window);
+        values.assign(ring.values.begin(), ring.values.begin() + kept);
+
+        summary.samples = ring.count;
+        summary.last    = ring.values[(ring.count - 1) % window];
+    }
+
+    // partial sorts are enough to find the two percentiles
+    int n   = values.size();
+    int p50 = n / 2;
+    int p99 = std::min(n - 1, n * 99 / 100);
+
+    std::nth_element(values.begin(), values.begin() + p99, values.end());
+    summary.p99 = values[p99];
+
+    std::nth_element(values.begin(), values.begin() + p50, values.begin() + p99);
+    summary.p50 = p50 < p99 ? values[p50] : summary.p99;
+
+    return summary;
+}
+
+void Profiler::clear() {
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    for(Ring &ring : rings) { ring.count = 0; }
+}
+
+void Profiler::write_csv(std::ostream &out) const {
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    out << "series,sample,value\n";
+
+    for(int s = 0; s < PROFILE_SERIES_COUNT; s++) {
+
+        const Ring &ring  = rings[s];
+        long        first = std::max(0L, ring.count - window);
+
+        for(long k = first; k < ring.count; k++) {
+
+            out << profile_names[s] << "," << k << "," << ring.values[k % window] << "\n";
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <ostream>
+
+
+// what the profiler keeps samples of - the stages are times in ms, the counters plain values
+enum Profile_Series {
+
+    PROFILE_STORE_TRAILS,    // Simulation::store_trails
+    PROFILE_JOIN,            // Simulation::join
+    PROFILE_GRAVITY,         // force evaluation, whole or for the bodies due in a block step
+    PROFILE_DRAW_BACKGROUND, // painting the background in on_draw
+    PROFILE_DRAW_TRAILS,     // drawing the trail cache in on_draw
+    PROFILE_DRAW_BODIES,     // drawing the bodies in on_draw
+    PROFILE_DRAW,            // the whole of on_draw
+
+    PROFILE_BODIES,          // number of bodies after each step
+    PROFILE_INTERACTIONS,    // pairs of bodies or tree nodes summed in each step
+    PROFILE_MERGES,          // bodies absorbed in each step
+    PROFILE_ALLOCATIONS,     // calls to operator new in each step, from any thread
+
+    PROFILE_SERIES_COUNT
+};
+
+const int profile_first_counter = PROFILE_BODIES;
+
+extern const char *const profile_names[PROFILE_SERIES_COUNT];
+
+// number of calls to operator new since the program started - counted by the replacement
+// operator new in profiler.cpp, which costs one relaxed atomic increment per allocation
+extern std::atomic<long> allocation_count;
+
+// keeps the last window samples of each series for rolling percentiles - samples can be added
+// from any thread, so the stepper and the ui can share one profiler
+class Profiler {
+
+public:
+    static const int window = 1024; // samples kept of each series
+
+    struct Summary {
+
+        long   samples = 0;  // samples added in total
+        double last    = 0;  // newest sample
+        double p50     = 0;  // median of the samples in the window
+        double p99     = 0;  // 99th percentile of the samples in the window
+    };
+
+    Profiler();
+
+    void    add(Profile_Series series, double value);
+    Summary summary(Profile_Series series) const;
+    void    clear();
+
+    // writes every sample in the window as series,sample,value lines, oldest first
+    void    write_csv(std::ostream &out) const;
+
+    std::atomic<bool> enabled;       // samples are only taken while set
+
+protected:
+    struct Ring {
+
+        std::array<double, window> values; // samples, wrapping around
+        long                       count;  // samples added in total
+    };
+
+    mutable std::mutex                       lock;   // guards rings
+    std::array<Ring, PROFILE_SERIES_COUNT>   rings;
+};
+
+// times the scope it is declared in and adds it to a profiler - does nothing, not even reading
+// the clock, if the profiler is null or disabled
+class Scoped_Timer {
+
+public:
+    Scoped_Timer(Profiler *profiler, Profile_Series series) :
+        profiler( profiler && profiler->enabled ? profiler : nullptr ),
+        series(series) {
+
+        if(this->profiler) { start = std::chrono::steady_clock::now(); }
+    }
+
+    ~Scoped_Timer() {
+
+        if(profiler) { profiler->add(series, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()); }
+    }
+
+    Scoped_Timer(const Scoped_Timer &) = delete;
+    Scoped_Timer &operator=(const Scoped_Timer &) = delete;
+
+protected:
+    Profiler                              *profiler;
+    Profile_Series                        series;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif /* PROFILER_H */
@@ -0,0 +1,231 @@
+#include "renderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+
+Renderer::Renderer(int threads) :
+    density_bodies(default_density_bodies),
+    stale(true),
+    trail_zoom(1.0),
+    trail_centre{0, 0},
+    trail_fade(1.0),
+    trail_step(-1),
+    density(threads) {
+}
+
+void Renderer::set_threads(int threads) {
+
+    density.set_threads(threads);
+}
+
+void Renderer::invalidate_trails() {
+
+    // keep showing the old cache scaled to the new view until whole trails arrive to redraw it
+    stale = true;
+}
+
+void Renderer::draw_trails(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height, const Draw_Snapshot &snapshot,
+                           double zoom, const std::vector<double> &centre, int traillength) {
+
+    int n = snapshot.m.size();
+
+    // the cache matches the size of the widget
+    if(!trail_surface || trail_surface->get_width() != width || trail_surface->get_height() != height) {
+
+        trail_surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+        invalidate_trails();
+    }
+
+    auto tc = Cairo::Context::create(trail_surface);
+    tc -> set_line_cap(Cairo::LINE_CAP_ROUND);
+    tc -> set_line_width(1*zoom);
+
+    // fraction of a trail's brightness kept each step, so a point has faded out traillength steps after it was drawn
+    double keep = traillength > 0 ? pow(0.02, 1.0/traillength) : 0.0;
+
+    if(snapshot.full_trails) {
+
+        // redraw the whole cache for the current view - each trail is drawn in bands of
+        // increasing age and decreasing brightness, matching how the cache fades
+        tc -> set_operator(Cairo::OPERATOR_CLEAR);
+        tc -> paint();
+        tc -> set_operator(Cairo::OPERATOR_OVER);
+
+        const int bands = 16;
+
+        for(int band = 0; band < bands; band++) {
+
+            for(int i = 0; i < n; i++) {
+
+                const std::array<double, 2> *trail = &snapshot.trail_points[snapshot.trail_start[i]];
+                int length = snapshot.trail_start[i+1] - snapshot.trail_start[i];
+                int first  = length *  band    / bands;
+                int last   = std::min(length * (band+1) / bands + 1, length);
+
+                if(last - first < 2) { continue; }
+
+                tc -> move_to(centre[0] + trail[first][0]*zoom, centre[1] + trail[first][1]*zoom);
+
+                for(int j = first+1; j < last; j++) {
+
+                    tc -> line_to(centre[0] + trail[j][0]*zoom, centre[1] + trail[j][1]*zoom);
+                }
+            }
+
+            tc -> set_source_rgba(1.0, 1.0, 1.0, 0.65 * pow(keep, (band + 0.5) * traillength / bands));
+            tc -> stroke();
+        }
+
+        stale           = false;
+        trail_zoom      = zoom;
+        trail_centre    = centre;
+        trail_fade      = 1.0;
+        trail_step      = snapshot.step;
+    }
+    else if(!stale && snapshot.new_steps > 0 && snapshot.step != trail_step) {
+
+        // fade the cache by the steps taken since the last snapshot - fading is saved up until it is
+        // large enough not to be lost to rounding in the 8 bit alpha channel
+        trail_fade *= pow(keep, snapshot.new_steps);
+
+        if(trail_fade < 0.9) {
+
+            tc -> set_operator(Cairo::OPERATOR_DEST_OUT);
+            tc -> set_source_rgba(0.0, 0.0, 0.0, 1.0 - trail_fade);
+            tc -> paint();
+            tc -> set_operator(Cairo::OPERATOR_OVER);
+            trail_fade = 1.0;
+        }
+
+        // append only the newest segments of each trail
+        for(int i = 0; i < n; i++) {
+
+            const std::array<double, 2> *trail = &snapshot.trail_points[snapshot.trail_start[i]];
+            int length = snapshot.trail_start[i+1] - snapshot.trail_start[i];
+
+            if(length < 2) { continue; }
+
+            tc -> move_to(centre[0] + trail[0][0]*zoom, centre[1] + trail[0][1]*zoom);
+
+            for(int j = 1; j < length; j++) {
+
+                tc -> line_to(centre[0] + trail[j][0]*zoom, centre[1] + trail[j][1]*zoom);
+            }
+        }
+
+        tc -> set_source_rgba(1.0, 1.0, 1.0, 0.65);
+        tc -> stroke();
+
+        // the same snapshot is drawn again whenever the window redraws before the next one arrives
+        trail_step = snapshot.step;
+    }
+
+    // paint the cache onto the widget, scaled and moved to the current view if it is stale
+    double s = zoom / trail_zoom;
+
+    cr -> save();
+    cr -> translate(centre[0] - trail_centre[0]*s, centre[1] - trail_centre[1]*s);
+    cr -> scale(s, s);
+    cr -> set_source(trail_surface, 0, 0);
+    cr -> paint();
+    cr -> restore();
+}
+
+void Renderer::draw_body(const Cairo::RefPtr<Cairo::Context>& cr, const Draw_Snapshot &snapshot, int i,
+                         double zoom, const std::vector<double> &centre) {
+
+    cr -> set_line_width(5*zoom);
+    cr -> arc(centre[0] + snapshot.x[i]*zoom, centre[1] + snapshot.y[i]*zoom, 10*snapshot.m[i]*zoom, 0, M_PI*2);
+    cr -> set_source_rgb(0.0, 0.0, 0.0);
+    cr -> fill_preserve();
+    cr -> set_source_rgb(0.4, 0.8, 0.1);
+    cr -> stroke();
+}
+
+void Renderer::draw_bodies(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height, const Draw_Snapshot &snapshot,
+                           double zoom, const std::vector<double> &centre) {
+
+    int n = snapshot.m.size();
+
+    if(density_bodies > 0 && n >= density_bodies) {
+
+        if(!density_surface || density_surface->get_width() != width || density_surface->get_height() != height) {
+
+            density_surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32, width, height);
+        }
+
+        density.splat(snapshot, width, height, zoom, centre);
+
+        // write straight into the surface's pixels, then paint it over the trails
+        density_surface -> flush();
+        density.tone_map(density_surface->get_data(), density_surface->get_stride());
+        density_surface -> mark_dirty();
+
+        cr -> save();
+        cr -> set_source(density_surface, 0, 0);
+        cr -> paint();
+        cr -> restore();
+
+        for(int i : density.large) { draw_body(cr, snapshot, i, zoom, centre); }
+
+        return;
+    }
+
+    // for each body in view, draw the body
+    for(int i = 0; i < n; i++) {
+
+        double x = centre[0] + snapshot.x[i]*zoom;
+        double y = centre[1] + snapshot.y[i]*zoom;
+        double r = (10*snapshot.m[i] + 2.5)*zoom;
+
+        if(x + r < 0 || x - r > width || y + r < 0 || y - r > height) { continue; }
+
+        draw_body(cr, snapshot, i, zoom, centre);
+    }
+}
+
+void Renderer::draw_profile(const Cairo::RefPtr<Cairo::Context>& cr, const Profiler &profiler, double x, double y) {
+
+    const double line = 16;  // spacing of the rows
+    const double cell = 90;  // width of the value columns
+
+    // darken the area behind the table so it stays readable over bright trails
+    cr -> set_source_rgba(0.0, 0.0, 0.0, 0.6);
+    cr -> rectangle(x - 5, y - line + 3, 120 + 3*cell, line*(PROFILE_SERIES_COUNT + 1) + 6);
+    cr -> fill();
+
+    cr -> set_source_rgb(0.6, 0.6, 0.6);
+    cr -> set_font_size(12);
+
+    const char *headings[] = {"p50", "p99", "last"};
+    for(int c = 0; c < 3; c++) {
+
+        cr -> move_to(x + 120 + c*cell, y);
+        cr -> show_text(headings[c]);
+    }
+
+    // times are shown in ms to three places, counters as whole numbers
+    for(int s = 0; s < PROFILE_SERIES_COUNT; s++) {
+
+        Profiler::Summary summary = profiler.summary((Profile_Series) s);
+        bool              time    = s < profile_first_counter;
+        double            row     = y + line*(s + 1);
+
+        cr -> move_to(x, row);
+        cr -> show_text(std::string(profile_names[s]) + (time ? " ms" : ""));
+
+        double values[] = {summary.p50, summary.p99, summary.last};
+        for(int c = 0; c < 3; c++) {
+
+            char text[32];
+            std::snprintf(text, sizeof(text), time ? "%.3f" : "%.0f", values[c]);
+
+            cr -> move_to(x + 120 + c*cell, row);
+            cr -> show_text(summary.samples > 0 ? text : "-");
+        }
+    }
+}
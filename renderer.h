@@ -0,0 +1,55 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "draw_snapshot.h"
+#include "density_splat.h"
+#include "profiler.h"
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+#include <vector>
+
+
+// draws snapshots of the simulation onto any cairo context - depends on cairomm but not gtkmm,
+// so the same drawing code runs in the gui and onto offscreen image surfaces
+class Renderer {
+
+public:
+    explicit Renderer(int threads = 0); // threads splatting bodies, 0 for one per hardware thread
+
+    // adds the newest segments of the snapshot's trails to the cached trails, or redraws the cache
+    // if the snapshot holds whole trails, then paints the cache onto cr
+    void draw_trails(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height, const Draw_Snapshot &snapshot,
+                     double zoom, const std::vector<double> &centre, int traillength);
+
+    // draws a circle for each body in view, or from density_bodies bodies on, splats them into an
+    // image painted in one go and only draws circles for the bodies large enough to be seen as circles
+    void draw_bodies(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height, const Draw_Snapshot &snapshot,
+                     double zoom, const std::vector<double> &centre);
+
+    // lists the p50 and p99 of each profiled series as a table with its top left corner at x, y
+    void draw_profile(const Cairo::RefPtr<Cairo::Context>& cr, const Profiler &profiler, double x, double y);
+
+    void set_threads(int threads);                    // restarts the threads splatting bodies
+    void invalidate_trails();                         // marks the cache as drawn for a different view
+    bool trails_stale() const { return stale; }      // true until whole trails have been drawn for the current view
+
+    int  density_bodies;                              // number of bodies from which they are splatted, 0 for never
+
+    static const int default_density_bodies = 16384;
+
+protected:
+    void draw_body(const Cairo::RefPtr<Cairo::Context>& cr, const Draw_Snapshot &snapshot, int i,
+                   double zoom, const std::vector<double> &centre);
+
+    Cairo::RefPtr<Cairo::ImageSurface>  trail_surface; // trails drawn so far, faded as they age
+    bool                                stale;         // true if the cache was drawn with a different zoom or centre
+    double                              trail_zoom;    // zoom the cache was drawn with
+    std::vector<double>                 trail_centre;  // centre the cache was drawn with
+    double                              trail_fade;    // fading owed to the cache but not yet applied
+    long                                trail_step;    // step of the last snapshot drawn into the cache, -1 if none
+
+    Density_Splat                       density;         // splats the bodies when there are too many for circles
+    Cairo::RefPtr<Cairo::ImageSurface>  density_surface; // tone mapped splat, the size of the widget
+};
+
+#endif /* RENDERER_H */
@@ -0,0 +1,135 @@
+#include "scenarios.h"
+#include <random>
+#include <stdexcept>
+#include <algorithm>
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+
+
+// gravitational constant of the force law used by the simulation, f = 100 m1 m2 / d^2
+static const double G = 100;
+
+static Body_Store disk(int n, std::mt19937 &rng) {
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // about 100 units between neighbours, so few bodies start out touching
+    Body_Store bodies;
+    double radius = 80 * std::sqrt((double) n);
+
+    for(int i = 0; i < n; i++) {
+
+        double r = radius * std::sqrt(unit(rng));
+        double a = 2 * M_PI * unit(rng);
+        bodies.push_back( Body{ {r*std::cos(a), r*std::sin(a)}, {unit(rng)-0.5, unit(rng)-0.5}, 0.2 + 0.4*unit(rng) } );
+    }
+
+    return bodies;
+}
+
+static Body_Store plummer(int n, std::mt19937 &rng) {
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // Plummer radius and masses chosen so the bodies rarely overlap at any count
+    Body_Store bodies;
+    double a    = 20 * std::sqrt((double) n);
+    double m    = 0.2;
+    double M    = m * n;
+
+    for(int i = 0; i < n; i++) {
+
+        // radius from the inverse of the cumulative mass, cut off at 10 Plummer radii
+        double r;
+        do { r = a / std::sqrt(std::pow(unit(rng), -2.0/3.0) - 1); } while(r > 10*a);
+
+        // speed as a fraction q of the local escape speed, by rejection sampling g(q) = q^2 (1-q^2)^3.5
+        double q;
+        do { q = unit(rng); } while(0.1 * unit(rng) > q*q * std::pow(1 - q*q, 3.5));
+
+        double v = q * std::sqrt(2 * G * M / std::sqrt(r*r + a*a));
+
+        // random directions in 3d, projected onto the plane
+        double cz = 2*unit(rng) - 1, pa = 2 * M_PI * unit(rng);
+        double cv = 2*unit(rng) - 1, va = 2 * M_PI * unit(rng);
+        double sz = std::sqrt(1 - cz*cz), sv = std::sqrt(1 - cv*cv);
+
+        bodies.push_back( Body{ {r*sz*std::cos(pa), r*sz*std::sin(pa)}, {v*sv*std::cos(va), v*sv*std::sin(va)}, m } );
+    }
+
+    return bodies;
+}
+
+static Body_Store galaxy(int n, std::mt19937 &rng) {
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // the disk stays inside the 2000 unit cutoff so every body feels the centre
+    double centre_mass = 20;
+    double disk_mass   = 20;
+    double inner       = 300;
+    double outer       = 1800;
+    double m           = disk_mass / n;
+
+    Body_Store bodies;
+    bodies.push_back( Body{ {0, 0}, {0, 0}, centre_mass } );
+
+    for(int i = 1; i < n; i++) {
+
+        double r = std::sqrt(inner*inner + (outer*outer - inner*inner) * unit(rng));
+        double a = 2 * M_PI * unit(rng);
+
+        // circular speed around the mass inside this radius, turning anticlockwise
+        double enclosed = centre_mass + disk_mass * (r*r - inner*inner) / (outer*outer - inner*inner);
+        double v        = std::sqrt(G * enclosed / r);
+
+        bodies.push_back( Body{ {r*std::cos(a), r*std::sin(a)}, {-v*std::sin(a), v*std::cos(a)}, m } );
+    }
+
+    return bodies;
+}
+
+static Body_Store cluster(int n, std::mt19937 &rng) {
+
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    // about one body per 20000 units square, so only a few start touching a neighbour and the rest
+    // meet as the cold cluster falls in on itself - packed much tighter, each merged body is large
+    // enough to touch the next, and the whole cluster merges into one in the first step
+    Body_Store bodies;
+    double radius = 80 * std::sqrt((double) n);
+
+    for(int i = 0; i < n; i++) {
+
+        double r = radius * std::sqrt(unit(rng));
+        double a = 2 * M_PI * unit(rng);
+        bodies.push_back( Body{ {r*std::cos(a), r*std::sin(a)}, {0.2*(unit(rng)-0.5), 0.2*(unit(rng)-0.5)}, 0.5 + 0.5*unit(rng) } );
+    }
+
+    return bodies;
+}
+
+Body_Store make_scenario(const std::string &name, int count, unsigned seed) {
+
+    std::mt19937 rng(seed);
+
+    if(name == "disk")    { return disk(count, rng); }
+    if(name == "plummer") { return plummer(count, rng); }
+    if(name == "galaxy")  { return galaxy(count, rng); }
+    if(name == "cluster") { return cluster(count, rng); }
+
+    throw std::invalid_argument("unknown scenario " + name);
+}
+
+const std::vector<std::string> &scenario_names() {
+
+    static const std::vector<std::string> names = { "disk", "plummer", "galaxy", "cluster" };
+    return names;
+}
+
+bool is_scenario(const std::string &name) {
+
+    const std::vector<std::string> &names = scenario_names();
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
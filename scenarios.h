@@ -0,0 +1,23 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+
+#include "body.h"
+#include <string>
+#include <vector>
+
+
+// reproducible initial conditions for benchmarks and batch runs - the same name, count and seed
+// always give the same bodies
+//   disk     - bodies spread uniformly over a disk at constant density with small random velocities
+//   plummer  - a Plummer sphere projected onto the plane, in virial equilibrium
+//   galaxy   - a light disk rotating about a heavy central body
+//   cluster  - a cold clump of bodies which collapses, to stress collision merging throughout a run
+Body_Store make_scenario(const std::string &name, int count, unsigned seed);
+
+// names accepted by make_scenario
+const std::vector<std::string> &scenario_names();
+
+// true if make_scenario accepts name
+bool is_scenario(const std::string &name);
+
+#endif /* SCENARIOS_H */
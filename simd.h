@@ -0,0 +1,226 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// each of these wraps one register type so that a kernel can be written once as a template over them;
+// a translation unit only sees the instruction sets it is compiled for, so the AVX2 kernels live in
+// their own file built with -mavx2 and are only called once the cpu has been checked for support
+
+struct Scalar_d {
+
+    typedef double scalar;
+    typedef double reg;
+    static const int width = 1;
+
+    static reg    zero()                       { return 0; }
+    static reg    set1(double a)               { return a; }
+    static reg    load(const double *p)        { return *p; }
+    static void   store(double *p, reg a)      { *p = a; }
+    static reg    add(reg a, reg b)            { return a + b; }
+    static reg    sub(reg a, reg b)            { return a - b; }
+    static reg    mul(reg a, reg b)            { return a * b; }
+    static reg    div(reg a, reg b)            { return a / b; }
+    static reg    sqrt(reg a)                  { return std::sqrt(a); }
+    static reg    madd(reg a, reg b, reg c)    { return a*b + c; }
+    static double sum(reg a)                   { return a; }
+
+    // a / d2^1.5
+    static reg    over_cube(reg a, reg d2)     { return a / (d2 * std::sqrt(d2)); }
+
+    // v where 0 < d2 <= c2, otherwise 0 - drops self interactions and pairs beyond the cutoff
+    static reg    keep_if(reg v, reg d2, reg c2) { return (d2 > 0 && d2 <= c2) ? v : 0; }
+
+    // v where 0 < d2, otherwise 0 - drops self interactions only
+    static reg    keep_nonzero(reg v, reg d2)  { return d2 > 0 ? v : 0; }
+
+    // true if any lane of a is below the same lane of b
+    static bool   any_less(reg a, reg b)       { return a < b; }
+};
+
+struct Scalar_f {
+
+    typedef float scalar;
+    typedef float reg;
+    static const int width = 1;
+
+    static reg    zero()                       { return 0; }
+    static reg    set1(float a)                { return a; }
+    static reg    load(const float *p)         { return *p; }
+    static reg    add(reg a, reg b)            { return a + b; }
+    static reg    sub(reg a, reg b)            { return a - b; }
+    static reg    mul(reg a, reg b)            { return a * b; }
+    static reg    div(reg a, reg b)            { return a / b; }
+    static reg    madd(reg a, reg b, reg c)    { return a*b + c; }
+    static double sum(reg a)                   { return a; }
+    static void   store_int(int *p, reg a)     { *p = (int) a; } // truncated towards 0
+    static reg    over_cube(reg a, reg d2)     { return a / (d2 * std::sqrt(d2)); }
+    static reg    keep_if(reg v, reg d2, reg c2) { return (d2 > 0 && d2 <= c2) ? v : 0; }
+    static reg    keep_nonzero(reg v, reg d2)  { return d2 > 0 ? v : 0; }
+
+    // true if any lane of a is below the same lane of b
+    static bool   any_less(reg a, reg b)       { return a < b; }
+};
+
+#if defined(__SSE2__)
+
+struct Sse2_d {
+
+    typedef double  scalar;
+    typedef __m128d reg;
+    static const int width = 2;
+
+    static reg    zero()                       { return _mm_setzero_pd(); }
+    static reg    set1(double a)               { return _mm_set1_pd(a); }
+    static reg    load(const double *p)        { return _mm_loadu_pd(p); }
+    static void   store(double *p, reg a)      { _mm_storeu_pd(p, a); }
+    static reg    add(reg a, reg b)            { return _mm_add_pd(a, b); }
+    static reg    sub(reg a, reg b)            { return _mm_sub_pd(a, b); }
+    static reg    mul(reg a, reg b)            { return _mm_mul_pd(a, b); }
+    static reg    div(reg a, reg b)            { return _mm_div_pd(a, b); }
+    static reg    sqrt(reg a)                  { return _mm_sqrt_pd(a); }
+    static reg    madd(reg a, reg b, reg c)    { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static double sum(reg a)                   { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+    static reg    over_cube(reg a, reg d2)     { return _mm_div_pd(a, _mm_mul_pd(d2, _mm_sqrt_pd(d2))); }
+
+    static reg    keep_if(reg v, reg d2, reg c2) {
+
+        reg mask = _mm_and_pd(_mm_cmpgt_pd(d2, _mm_setzero_pd()), _mm_cmple_pd(d2, c2));
+        return _mm_and_pd(v, mask);
+    }
+
+    static reg    keep_nonzero(reg v, reg d2)  { return _mm_and_pd(v, _mm_cmpgt_pd(d2, _mm_setzero_pd())); }
+    static bool   any_less(reg a, reg b)       { return _mm_movemask_pd(_mm_cmplt_pd(a, b)) != 0; }
+};
+
+// the float registers use the reciprocal square root estimate refined by one Newton step, which is
+// good to about 23 bits and much faster than a square root and a division
+struct Sse2_f {
+
+    typedef float  scalar;
+    typedef __m128 reg;
+    static const int width = 4;
+
+    static reg    zero()                       { return _mm_setzero_ps(); }
+    static reg    set1(float a)                { return _mm_set1_ps(a); }
+    static reg    load(const float *p)         { return _mm_loadu_ps(p); }
+    static reg    add(reg a, reg b)            { return _mm_add_ps(a, b); }
+    static reg    sub(reg a, reg b)            { return _mm_sub_ps(a, b); }
+    static reg    mul(reg a, reg b)            { return _mm_mul_ps(a, b); }
+    static reg    div(reg a, reg b)            { return _mm_div_ps(a, b); }
+    static reg    madd(reg a, reg b, reg c)    { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static void   store_int(int *p, reg a)     { _mm_storeu_si128((__m128i *) p, _mm_cvttps_epi32(a)); }
+
+    static double sum(reg a) {
+
+        reg half = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+    }
+
+    static reg    over_cube(reg a, reg d2) {
+
+        reg r = _mm_rsqrt_ps(d2);
+        r     = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(d2, _mm_mul_ps(r, r))));
+        return _mm_mul_ps(a, _mm_mul_ps(r, _mm_mul_ps(r, r)));
+    }
+
+    static reg    keep_if(reg v, reg d2, reg c2) {
+
+        reg mask = _mm_and_ps(_mm_cmpgt_ps(d2, _mm_setzero_ps()), _mm_cmple_ps(d2, c2));
+        return _mm_and_ps(v, mask);
+    }
+
+    static reg    keep_nonzero(reg v, reg d2)  { return _mm_and_ps(v, _mm_cmpgt_ps(d2, _mm_setzero_ps())); }
+    static bool   any_less(reg a, reg b)       { return _mm_movemask_ps(_mm_cmplt_ps(a, b)) != 0; }
+};
+
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+struct Avx2_d {
+
+    typedef double  scalar;
+    typedef __m256d reg;
+    static const int width = 4;
+
+    static reg    zero()                       { return _mm256_setzero_pd(); }
+    static reg    set1(double a)               { return _mm256_set1_pd(a); }
+    static reg    load(const double *p)        { return _mm256_loadu_pd(p); }
+    static void   store(double *p, reg a)      { _mm256_storeu_pd(p, a); }
+    static reg    add(reg a, reg b)            { return _mm256_add_pd(a, b); }
+    static reg    sub(reg a, reg b)            { return _mm256_sub_pd(a, b); }
+    static reg    mul(reg a, reg b)            { return _mm256_mul_pd(a, b); }
+    static reg    div(reg a, reg b)            { return _mm256_div_pd(a, b); }
+    static reg    sqrt(reg a)                  { return _mm256_sqrt_pd(a); }
+    static reg    madd(reg a, reg b, reg c)    { return _mm256_fmadd_pd(a, b, c); }
+
+    static double sum(reg a) {
+
+        __m128d half = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    }
+
+    static reg    over_cube(reg a, reg d2)     { return _mm256_div_pd(a, _mm256_mul_pd(d2, _mm256_sqrt_pd(d2))); }
+
+    static reg    keep_if(reg v, reg d2, reg c2) {
+
+        reg mask = _mm256_and_pd(_mm256_cmp_pd(d2, _mm256_setzero_pd(), _CMP_GT_OQ), _mm256_cmp_pd(d2, c2, _CMP_LE_OQ));
+        return _mm256_and_pd(v, mask);
+    }
+
+    static reg    keep_nonzero(reg v, reg d2)  { return _mm256_and_pd(v, _mm256_cmp_pd(d2, _mm256_setzero_pd(), _CMP_GT_OQ)); }
+    static bool   any_less(reg a, reg b)       { return _mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)) != 0; }
+};
+
+struct Avx2_f {
+
+    typedef float  scalar;
+    typedef __m256 reg;
+    static const int width = 8;
+
+    static reg    zero()                       { return _mm256_setzero_ps(); }
+    static reg    set1(float a)                { return _mm256_set1_ps(a); }
+    static reg    load(const float *p)         { return _mm256_loadu_ps(p); }
+    static reg    add(reg a, reg b)            { return _mm256_add_ps(a, b); }
+    static reg    sub(reg a, reg b)            { return _mm256_sub_ps(a, b); }
+    static reg    mul(reg a, reg b)            { return _mm256_mul_ps(a, b); }
+    static reg    div(reg a, reg b)            { return _mm256_div_ps(a, b); }
+    static reg    madd(reg a, reg b, reg c)    { return _mm256_fmadd_ps(a, b, c); }
+    static void   store_int(int *p, reg a)     { _mm256_storeu_si256((__m256i *) p, _mm256_cvttps_epi32(a)); }
+
+    static double sum(reg a) {
+
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+        half        = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        return _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+    }
+
+    static reg    over_cube(reg a, reg d2) {
+
+        reg r = _mm256_rsqrt_ps(d2);
+        r     = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_fnmadd_ps(d2, _mm256_mul_ps(r, r), _mm256_set1_ps(3.0f)));
+        return _mm256_mul_ps(a, _mm256_mul_ps(r, _mm256_mul_ps(r, r)));
+    }
+
+    static reg    keep_if(reg v, reg d2, reg c2) {
+
+        reg mask = _mm256_and_ps(_mm256_cmp_ps(d2, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_cmp_ps(d2, c2, _CMP_LE_OQ));
+        return _mm256_and_ps(v, mask);
+    }
+
+    static reg    keep_nonzero(reg v, reg d2)  { return _mm256_and_ps(v, _mm256_cmp_ps(d2, _mm256_setzero_ps(), _CMP_GT_OQ)); }
+    static bool   any_less(reg a, reg b)       { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)) != 0; }
+};
+
+#endif
+
+#endif /* SIMD_H */
@@ -0,0 +1,569 @@
+#include "simulation.h"
+#include "domains.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+
+bool parse_force_method(const std::string &name, Force_Method &method) {
+
+    if(     name == "direct") { method = DIRECT_SUM; }
+    else if(name == "tree")   { method = BARNES_HUT; }
+    else if(name == "mesh")   { method = PARTICLE_MESH; }
+    else if(name == "p3m")    { method = P3M; }
+    else if(name == "cells")  { method = CELL_LIST; }
+    else                      { return false; }
+
+    return true;
+}
+
+Simulation::Simulation(int threads) :
+    traillength(360),
+    dt(1.0),
+    max_substeps(64),
+    accumulator(0),
+    max_level(8),
+    eta(0.05),
+    force_method(DIRECT_SUM),
+    theta(0.5),
+    mesh_size(256),
+    cutoff(2000),
+    softening(0),
+    skin(200),
+    single(false),
+    merging(true),
+    fused(false),
+    steps(0),
+    trail_steps(0),
+    merges(0),
+    evaluations(0),
+    interactions(0),
+    profiler(nullptr),
+    domains(nullptr),
+    forces_valid(false),
+    profiled_interactions(0),
+    profiled_merges(0),
+    profiled_allocations(0),
+    pool(threads) {
+
+    // the widest direct sum kernel the cpu supports was picked by direct for the default policy
+    kernel_name = direct.name;
+
+    reset();
+}
+
+void Simulation::reset() {
+
+    bodies = { Body{ {  0,   0}, { 1.2,    0}, 1.0 },
+               Body{ {  0, 100}, {   0, -1.2}, 1.0 },
+               Body{ {100,   0}, {   0,  1.2}, 1.0 },
+               Body{ {100, 100}, {-1.2,    0}, 1.0 } };
+
+    forces_valid = false;
+}
+
+void Simulation::clear() {
+
+    bodies.clear();
+    forces_valid = false;
+
+    // the mesh keeps its spacing while the bodies fit it and the lists are kept while the handles match,
+    // so bodies loaded next would otherwise get forces depending on the ones cleared
+    mesh       = Particle_Mesh();
+    neighbours = Neighbour_List();
+}
+
+Body_Handle Simulation::add(const Body &body) {
+
+    forces_valid = false;
+    return bodies.push_back(body);
+}
+
+void Simulation::set_threads(int threads) {
+
+    pool.resize(threads);
+}
+
+int Simulation::advance(double time) {
+
+    accumulator += time;
+
+    // whole substeps in the direction time is running, leaving the remainder for next time
+    int substeps = std::min<double>(std::floor(std::abs(accumulator) / dt), max_substeps);
+    double h     = accumulator < 0 ? -dt : dt;
+
+    // the trails are stored once, at the end of the last substep
+    for(int s = 0; s < substeps; s++) {
+
+        substep(h, s == substeps - 1);
+        accumulator -= h;
+    }
+
+    // fell too far behind - run slower than asked rather than taking ever more substeps
+    if(std::abs(accumulator) >= dt) { accumulator = std::fmod(accumulator, dt); }
+
+    if(substeps > 0) { profile_counters(); }
+
+    return substeps;
+}
+
+void Simulation::step() {
+
+    store_trails();
+    substep(dt);
+    profile_counters();
+}
+
+void Simulation::profile_counters() {
+
+    if(!profiler || !profiler->enabled) { return; }
+
+    // counts since the last call, so each sample covers one step or one call to advance()
+    long allocations = allocation_count;
+
+    profiler->add(PROFILE_BODIES,       bodies.size());
+    profiler->add(PROFILE_INTERACTIONS, interactions - profiled_interactions);
+    profiler->add(PROFILE_MERGES,       merges - profiled_merges);
+    profiler->add(PROFILE_ALLOCATIONS,  allocations - profiled_allocations);
+
+    profiled_interactions = interactions;
+    profiled_merges       = merges;
+    profiled_allocations  = allocations;
+}
+
+void Simulation::substep(double h, bool store) {
+
+    join();
+
+    // the shift below is only defined for levels a long can count the ticks of
+    max_level = std::min(std::max(max_level, 0), max_timestep_level);
+
+    int    n     = bodies.size();
+    long   ticks = 1L << max_level;
+    double tick  = h / ticks;
+
+    // every step ends together at the end of a block, so the accelerations left over from the end
+    // of the last block open the next one unless bodies have changed - then they are all found again
+    if(!forces_valid || (int) bodies.ax.size() != n) {
+
+        gravity();
+
+        for(int i = 0; i < n; i++) {
+
+            bodies.ax[i]    = ax[i];
+            bodies.ay[i]    = ay[i];
+            bodies.level[i] = choose_level(i, h, 0, 0);
+        }
+
+        evaluations += n;
+    }
+
+    // open the first step of each body with half a kick
+    for(int i = 0; i < n; i++) { kick(i, tick * (ticks >> bodies.level[i]) / 2); }
+
+    if(fused) { fused_ticks(h, ticks, store); }
+    else      { separate_ticks(h, ticks, store); }
+
+    forces_valid = true;
+    steps++;
+}
+
+void Simulation::separate_ticks(double h, long ticks, bool store) {
+
+    double tick = h / ticks;
+    long   t    = 0;
+
+    while(t < ticks) {
+
+        // drift everything to the end of the shortest step in progress
+        int deepest = 0;
+        for(int i = 0; i < bodies.size(); i++) { deepest = std::max(deepest, bodies.level[i]); }
+
+        // to the next boundary of the deepest level rather than a whole step of it, since a merge can take
+        // away the deepest body part way through its step and leave t between boundaries of the rest
+        long stride = (ticks >> deepest) - t % (ticks >> deepest);
+        drift(tick * stride);
+        t += stride;
+
+        // close encounters are caught at every tick by searching around the bodies whose steps end now -
+        // two bodies which are both between steps are found when the first of their steps ends
+        list_active(t, ticks);
+
+        if((int) active.size() == bodies.size()) {
+
+            join();
+        }
+        else if(!active.empty()) {
+
+            join(active);
+        }
+
+        // only the bodies whose step ends now have their forces found - merging renumbers the bodies
+        list_active(t, ticks);
+        active_gravity();
+        close_steps(h, t, ticks);
+    }
+
+    if(store) { store_trails(); }
+}
+
+void Simulation::fused_ticks(double h, long ticks, bool store) {
+
+    double tick    = h / ticks;
+    long   t       = 0;
+    int    deepest = 0;
+
+    for(int i = 0; i < bodies.size(); i++) { deepest = std::max(deepest, bodies.level[i]); }
+
+    if(store) { bodies.trails.set_capacity(traillength); }
+
+    while(t < ticks) {
+
+        // the levels of the bodies between steps are seen as they drift, and those of the bodies whose
+        // steps end are known once they are closed, so finding the next stride needs no pass of its own
+        long stride = (ticks >> deepest) - t % (ticks >> deepest);
+        t          += stride;
+        deepest     = sweep(tick * stride, t, ticks, store && t == ticks);
+
+        if(store && t == ticks) { trail_steps++; }
+
+        long before = merges;
+
+        if(contact_gravity()) {
+
+            // the direct sum finds the distance of every pair it sums anyway, so it lists the colliding
+            // pairs as it goes - merges are rare, and the forces are only found again when there are some
+            active_gravity();
+
+            if(!pairs.empty()) {
+
+                Scoped_Timer timer(profiler, PROFILE_JOIN);
+                merge_pairs();
+            }
+        }
+        else if((int) active.size() == bodies.size()) {
+
+            join();
+        }
+        else if(!active.empty()) {
+
+            join(active);
+        }
+
+        // merging renumbers the bodies, and takes some of them out of the deepest level
+        if(merges != before) { deepest = list_active(t, ticks); }
+
+        if(merges != before || !contact_gravity()) { active_gravity(); }
+
+        deepest = std::max(deepest, close_steps(h, t, ticks));
+    }
+}
+
+int Simulation::sweep(double h, long t, long ticks, bool store) {
+
+    active.clear();
+    int deepest = 0;
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        bodies.x[i] += bodies.vx[i] * h;
+        bodies.y[i] += bodies.vy[i] * h;
+
+        if(store) { bodies.trails.push(bodies.trail[i], bodies.x[i], bodies.y[i]); }
+
+        if(t % (ticks >> bodies.level[i]) == 0) { active.push_back(i); }
+        else                                    { deepest = std::max(deepest, bodies.level[i]); }
+    }
+
+    return deepest;
+}
+
+int Simulation::list_active(long t, long ticks) {
+
+    active.clear();
+    int deepest = 0;
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        if(t % (ticks >> bodies.level[i]) == 0) { active.push_back(i); }
+        else                                    { deepest = std::max(deepest, bodies.level[i]); }
+    }
+
+    return deepest;
+}
+
+void Simulation::active_gravity() {
+
+    if((int) active.size() == bodies.size()) {
+
+        gravity();
+    }
+    else if(domains) {
+
+        Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += domains->accelerations(bodies, active, cutoff_distance(), softening, theta, single, ax, ay);
+    }
+    else if(force_method == BARNES_HUT) {
+
+        Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+        interactions += tree_accelerations(bodies, active, quadtree, theta, cutoff_distance(), pool, ax, ay);
+    }
+    else if(force_method == CELL_LIST && cutoff > 0) {
+
+        Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += cell_accelerations(bodies, active, neighbours, direct, cutoff, skin, softening, pool, ax, ay);
+    }
+    else if(force_method == PARTICLE_MESH || force_method == P3M) {
+
+        Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+        interactions += mesh_accelerations(bodies, active, mesh, mesh_size, force_method == P3M, cutoff_distance(), pool, ax, ay);
+    }
+    else {
+
+        Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += direct_accelerations(bodies, active, direct, cutoff_distance(), softening, pool, ax, ay, &pairs);
+    }
+}
+
+int Simulation::close_steps(double h, long t, long ticks) {
+
+    double tick    = h / ticks;
+    int    deepest = 0;
+
+    evaluations += active.size();
+
+    for(int i : active) {
+
+        // close the step with the other half kick, estimating the jerk over it
+        double step = tick * (ticks >> bodies.level[i]);
+        double jx   = (ax[i] - bodies.ax[i]) / std::abs(step);
+        double jy   = (ay[i] - bodies.ay[i]) / std::abs(step);
+
+        bodies.ax[i] = ax[i];
+        bodies.ay[i] = ay[i];
+        kick(i, step/2);
+
+        // steps can shorten at once but only double each time, and a longer step has to start
+        // on a boundary of its level so that it ends with the block
+        int next = std::max(choose_level(i, h, jx, jy), bodies.level[i] - 1);
+        while(t % (ticks >> next) != 0) { next++; }
+
+        bodies.level[i] = next;
+        deepest         = std::max(deepest, next);
+
+        // the next block opens the steps left after its own join
+        if(t < ticks) { kick(i, tick * (ticks >> next) / 2); }
+    }
+
+    return deepest;
+}
+
+int Simulation::choose_level(int i, double h, double jx, double jy) const {
+
+    // the time to fall the body's own radius of 10*mass, and once the jerk is known the time
+    // its acceleration takes to change - close encounters make both short
+    double a    = std::sqrt(bodies.ax[i]*bodies.ax[i] + bodies.ay[i]*bodies.ay[i]);
+    double j    = std::sqrt(jx*jx + jy*jy);
+    double wish = std::abs(h);
+
+    if(a > 0) { wish = std::min(wish, std::sqrt(eta * 10 * bodies.m[i] / a)); }
+    if(j > 0) { wish = std::min(wish, eta * a / j); }
+
+    // the shortest power of two fraction of the block at least as short as the wished for step
+    int level = 0;
+    while(level < max_level && std::abs(h) / (1L << level) > wish) { level++; }
+
+    return level;
+}
+
+void Simulation::store_trails() {
+
+    Scoped_Timer timer(profiler, PROFILE_STORE_TRAILS);
+
+    // resize every trail at once when the trail length changes
+    bodies.trails.set_capacity(traillength);
+
+    // push current position onto the front of each body's ring, overwriting its oldest point once full
+    for(int i = 0; i < bodies.size(); i++) {
+
+        bodies.trails.push(bodies.trail[i], bodies.x[i], bodies.y[i]);
+    }
+
+    trail_steps++;
+}
+
+void Simulation::gravity() {
+
+    Scoped_Timer timer(profiler, PROFILE_GRAVITY);
+
+    // find the acceleration of every body at the current positions using the selected method - the
+    // workers pick the same kernel as direct would here
+    if(domains) {
+
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += domains->accelerations(bodies, cutoff_distance(), softening, theta, single, ax, ay);
+    }
+    else if(force_method == BARNES_HUT) {
+
+        interactions += tree_accelerations(bodies, quadtree, theta, cutoff_distance(), pool, ax, ay);
+    }
+    else if(force_method == CELL_LIST && cutoff > 0) {
+
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += cell_accelerations(bodies, neighbours, direct, cutoff, skin, softening, pool, ax, ay);
+    }
+    else if(force_method == PARTICLE_MESH || force_method == P3M) {
+
+        interactions += mesh_accelerations(bodies, mesh, mesh_size, force_method == P3M, cutoff_distance(), pool, ax, ay);
+    }
+    else {
+
+        // the kernel is only picked again if its settings have changed since the last evaluation
+        direct.select(kernel_policy());
+        kernel_name   = direct.name;
+        interactions += direct_accelerations(bodies, direct, cutoff_distance(), softening, pool, ax, ay, &pairs);
+    }
+}
+
+Kernel_Policy Simulation::kernel_policy() const {
+
+    Kernel_Policy policy;
+    policy.single    = single;
+    policy.cutoff    = cutoff > 0;
+    policy.softening = softening > 0;
+    policy.contacts  = contact_gravity();
+
+    return policy;
+}
+
+bool Simulation::contact_gravity() const {
+
+    // the float kernels' distances are too coarse to be sure of finding every pair the collision finder
+    // would, and the other methods never see most pairs at all
+    return fused && merging && !single && !domains && force_method == DIRECT_SUM;
+}
+
+double Simulation::cutoff_distance() const {
+
+    return cutoff > 0 ? cutoff : HUGE_VAL;
+}
+
+void Simulation::kick(int i, double h) {
+
+    bodies.vx[i] += bodies.ax[i] * h; // applying accelaration to body
+    bodies.vy[i] += bodies.ay[i] * h;
+}
+
+void Simulation::drift(double h) {
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        bodies.x[i]  += bodies.vx[i] * h; // move body by velocity
+        bodies.y[i]  += bodies.vy[i] * h;
+    }
+}
+
+void Simulation::join() {
+
+    if(!merging) { return; }
+
+    Scoped_Timer timer(profiler, PROFILE_JOIN);
+
+    // find the overlapping pairs, then merge each group of touching bodies into its heaviest member
+    collisions.find(bodies, pool, pairs);
+    merge_pairs();
+}
+
+void Simulation::join(const std::vector<int> &candidates) {
+
+    if(!merging) { return; }
+
+    Scoped_Timer timer(profiler, PROFILE_JOIN);
+
+    collisions.find(bodies, candidates, pool, pairs);
+    merge_pairs();
+}
+
+int Simulation::merge_pairs() {
+
+    int merged = collisions.merge(bodies, pairs);
+
+    // merged bodies change mass and velocity and the last bodies move into the places of the absorbed ones
+    if(merged > 0) { forces_valid = false; }
+
+    merges += merged;
+
+    return merged;
+}
+
+bool Simulation::load(const std::string &path) {
+
+    std::ifstream in(path);
+    if(!in) { return false; }
+
+    Body_Store loaded;
+    Body       body;
+
+    while(in >> body.pos[0] >> body.pos[1] >> body.vel[0] >> body.vel[1] >> body.mass) {
+
+        loaded.push_back(body);
+    }
+
+    // stopped early on something that wasn't a number
+    if(!in.eof()) { return false; }
+
+    clear();
+    for(int i = 0; i < loaded.size(); i++) { add(loaded.get(i)); }
+
+    return true;
+}
+
+double Simulation::energy() const {
+
+    double kinetic   = 0;
+    double potential = 0;
+    int    n         = bodies.size();
+    double reach     = cutoff_distance();
+    double e2        = softening * softening;
+    double shift     = cutoff > 0 ? 1/std::sqrt(reach*reach + e2) : 0;
+
+    for(int i = 0; i < n; i++) {
+
+        kinetic += 0.5 * bodies.m[i] * (bodies.vx[i]*bodies.vx[i] + bodies.vy[i]*bodies.vy[i]);
+
+        // the potential of 100 m1 m2 / d^2, softened as the direct sum is, and shifted to be continuous
+        // at the cutoff if there is one
+        for(int j = i+1; j < n; j++) {
+
+            double dx = bodies.x[i] - bodies.x[j];
+            double dy = bodies.y[i] - bodies.y[j];
+            double d2 = dx*dx + dy*dy;
+
+            if(d2 > 0 && d2 <= reach*reach) { potential -= 100 * bodies.m[i] * bodies.m[j] * (1/std::sqrt(d2 + e2) - shift); }
+        }
+    }
+
+    return kinetic + potential;
+}
+
+void Simulation::print(std::ostream &out) const {
+
+    out << std::setprecision(17);
+
+    for(int i = 0; i < bodies.size(); i++) {
+
+        out << bodies.x[i] << " " << bodies.y[i] << " " << bodies.vx[i] << " " << bodies.vy[i] << " " << bodies.m[i] << "\n";
+    }
+}
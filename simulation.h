@@ -0,0 +1,140 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "body.h"
+#include "forces.h"
+#include "collisions.h"
+#include "profiler.h"
+#include <vector>
+#include <array>
+#include <string>
+#include <ostream>
+
+class Domain_Decomposition;
+
+enum Force_Method {
+
+    DIRECT_SUM,    // sums the force between every pair of bodies - O(N^2)
+    BARNES_HUT,    // approximates distant groups of bodies by their centre of mass - O(N log N)
+    PARTICLE_MESH, // finds the force on a grid with FFTs, smoothing it over a couple of nodes - O(N + G^2 log G)
+    P3M,           // the mesh for the long range force plus a direct sum between nearby bodies
+    CELL_LIST      // sums the same pairs as the direct sum, found through cells as wide as the cutoff - O(N * neighbours),
+                   // and the direct sum itself if there is no cutoff
+};
+
+// deepest timestep level allowed - a block is 2^max_level ticks, counted in a long, which is only
+// 32 bits on some platforms
+const int max_timestep_level = 30;
+
+// reads the name of a force method - direct, tree, mesh, p3m or cells - false if it isn't one
+bool parse_force_method(const std::string &name, Force_Method &method);
+
+// the stepping core of the simulation, with no dependency on gtkmm so that it can be run
+// headless as well as behind Gravity_Draw
+class Simulation {
+
+public:
+    explicit Simulation(int threads = 0); // 0 uses one thread per hardware thread
+
+    // bodies are advanced with a kick-drift-kick leapfrog at a fixed timestep dt, which stays stable
+    // at much larger steps than moving bodies part way through the force loop did - each substep
+    // of dt is a block in which every body takes 2^level steps of its own, with the level chosen from
+    // its acceleration and jerk so that close encounters are stepped finely without slowing the rest
+
+    int  advance(double time); // adds time to the accumulator and runs the whole substeps it holds, storing
+                               // trails once at the end - returns the number of substeps run
+    void step();              // stores trails, then runs one substep of dt
+    void substep(double h, bool store = false); // advances the bodies by a block of h, joining colliding bodies at
+                                                // every tick, and stores trails at the end if store is set
+    void gravity();           // calculates gravitational forces between bodies into ax and ay
+    void join();              // joins bodies together if they collide
+    void join(const std::vector<int> &candidates); // joins only the collisions involving the candidate bodies
+    void store_trails();      // stores data used to draw trails
+    void reset();             // replaces the bodies with the initial four
+    void clear();             // removes every body, and the grids and lists the force methods kept for them
+    Body_Handle add(const Body &body); // adds a body, returning its handle
+    void set_threads(int threads); // restarts the worker threads
+
+    // total kinetic and potential energy of the bodies, with the potential of the cut off force law
+    double energy() const;
+
+    // reads bodies from a text file with one "x y vx vy mass" line per body, replacing the current ones
+    bool load(const std::string &path);
+
+    // writes the bodies in the format read by load
+    void print(std::ostream &out) const;
+
+    Body_Store   bodies;       // positions, velocities, masses and trails of bodies
+    int          traillength;  // length of trails behind bodies
+    double       dt;           // simulated time advanced by each substep
+    int          max_substeps; // most substeps advance() runs at once - any more time is dropped
+    double       accumulator;  // simulated time passed to advance() but not yet stepped
+    int          max_level;    // deepest timestep level - the shortest step is dt / 2^max_level
+    double       eta;          // accuracy of the timestep criteria - smaller gives shorter steps
+    Force_Method force_method; // method used to calculate gravitational forces
+    double       theta;        // opening angle of the Barnes-Hut tree
+    int          mesh_size;    // nodes along each side of the particle mesh, a power of 2
+    double       cutoff;       // pairs further apart than this are ignored, 0 for no cutoff
+    double       softening;    // length added in quadrature to distances in the direct sum, 0 for none
+    double       skin;         // margin of the Verlet lists kept by the cell list method, 0 to search the cells every time
+    bool         single;       // direct sum in float, relative to an origin which follows the bodies
+    bool         merging;      // true if colliding bodies are joined
+    bool         fused;        // drifts, lists the bodies due and stores trails in one sweep per tick, and takes the
+                               // colliding pairs from the direct sum's distances rather than a search of their own -
+                               // the separate stages, which give the same results, are kept to check it against
+    long         steps;        // number of substeps simulated
+    long         trail_steps;  // number of times the trails have been stored
+    long         merges;       // number of bodies absorbed by collisions
+    long         evaluations;  // number of times the force on a body has been found
+    long         interactions; // number of pairs of bodies, or bodies and tree nodes, summed in force evaluations
+    Profiler    *profiler;     // times the stages of each step and counts what they did, if set
+    Domain_Decomposition *domains; // worker processes which find the forces if set, with the direct sum whatever the method
+
+    const char  *kernel_name;  // name of the direct sum kernel chosen for this cpu and the settings
+
+protected:
+    void kick(int i, double h); // changes the velocity of body i by h times its acceleration
+    void drift(double h);       // moves bodies by h times their velocities
+
+    // the ticks of a block of h after its opening kicks, with each stage a pass over the bodies of its own
+    void separate_ticks(double h, long ticks, bool store);
+
+    // as above with the per body stages of each tick fused into one sweep, and with the direct sum
+    // finding the colliding pairs as it goes
+    void fused_ticks(double h, long ticks, bool store);
+
+    // drifts bodies by h, pushing each new position onto its trail if store is set, and lists the bodies
+    // whose steps end at tick t of ticks - returns the deepest level of the bodies not listed
+    int  sweep(double h, long t, long ticks, bool store);
+
+    int  list_active(long t, long ticks); // lists the bodies whose steps end at tick t, returning the deepest level of the rest
+    void active_gravity();                // finds the accelerations of the active bodies, of every body if all are active
+    int  close_steps(double h, long t, long ticks); // closes the steps of the active bodies, returning their deepest next level
+    int  merge_pairs();                   // merges the colliding pairs in pairs, returning the number of bodies removed
+    bool contact_gravity() const;         // true if the direct sum lists the colliding pairs for join
+
+    void profile_counters();    // adds the counters for the step just taken to the profiler
+
+    Kernel_Policy kernel_policy() const;  // policy of the direct sum kernel for the current settings
+    double        cutoff_distance() const; // cutoff, or infinity if there is none
+
+    // level of the next step of body i in a block of h, given the jerk over its last step
+    int choose_level(int i, double h, double jx, double jy) const;
+
+    std::vector<double>                 ax;                 // x acceleration found by the last force evaluation
+    std::vector<double>                 ay;                 // y acceleration found by the last force evaluation
+    std::vector<int>                    active;             // bodies whose steps end at the current tick
+    bool                                forces_valid;       // false once the bodies' accelerations no longer match them
+    long                                profiled_interactions; // interactions when profile_counters was last called
+    long                                profiled_merges;       // merges when profile_counters was last called
+    long                                profiled_allocations;  // allocation_count when profile_counters was last called
+    Direct_Sum                          direct;             // vectorised direct sum kernel chosen for this cpu and policy
+    Thread_Pool                         pool;               // persistent worker threads
+    Collision_Finder                    collisions;         // spatial hash used to find colliding bodies
+    std::vector<std::array<int, 2>>     pairs;              // colliding pairs found this tick
+    Quadtree                            quadtree;           // tree used by the Barnes-Hut force method
+    Particle_Mesh                       mesh;               // grid used by the particle mesh force methods
+    Neighbour_List                      neighbours;         // cells and lists used by the cell list force method
+};
+
+#endif /* SIMULATION_H */
@@ -0,0 +1,259 @@
+#include "snapshot_file.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "snapshot files are written and mapped as little-endian"
+#endif
+
+// longest trail a snapshot may ask for - restoring allocates a ring this long for every body up front,
+// so a corrupt length could otherwise ask for any amount of memory
+static const int max_snapshot_trail = 1 << 16;
+
+static uint64_t align(uint64_t offset) {
+
+    return (offset + 63) / 64 * 64;
+}
+
+// writes bytes of values at offset, padding with zeros up to it
+static void write_section(std::ofstream &out, uint64_t offset, const void *values, size_t bytes) {
+
+    static const char zeros[64] = {};
+
+    uint64_t at = out.tellp();
+    out.write(zeros, offset - at);
+    out.write((const char *) values, bytes);
+}
+
+bool save_snapshot(const std::string &path, const Simulation &sim, const Snapshot_View &view) {
+
+    const Body_Store &bodies = sim.bodies;
+    uint64_t n = bodies.size();
+
+    // trails are stored newest point first, packed one after another
+    std::vector<uint64_t> trail_start(n+1);
+    std::vector<double>   trail_points;
+
+    for(uint64_t i = 0; i < n; i++) {
+
+        trail_start[i] = trail_points.size() / 2;
+
+        int length = bodies.trails.length(bodies.trail[i]);
+        for(int k = 0; k < length; k++) {
+
+            const std::array<double, 2> &point = bodies.trails.point(bodies.trail[i], k);
+            trail_points.push_back(point[0]);
+            trail_points.push_back(point[1]);
+        }
+    }
+
+    trail_start[n] = trail_points.size() / 2;
+
+    std::vector<int32_t> level(bodies.level.begin(), bodies.level.end());
+
+    Snapshot_Header header = {};
+    std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+    header.version      = snapshot_version;
+    header.header_bytes = sizeof(Snapshot_Header);
+    header.bodies       = n;
+    header.trail_points = trail_start[n];
+    header.traillength  = sim.traillength;
+    header.force_method = sim.force_method;
+    header.max_level    = sim.max_level;
+    header.dt           = sim.dt;
+    header.eta          = sim.eta;
+    header.theta        = sim.theta;
+    header.cutoff       = sim.cutoff;
+    header.softening    = sim.softening;
+    header.skin         = sim.skin;
+    header.single       = sim.single;
+    header.merging      = sim.merging;
+    header.mesh_size    = sim.mesh_size;
+    header.steps        = sim.steps;
+    header.merges       = sim.merges;
+    header.zoom         = view.zoom;
+    header.centre[0]    = view.centre[0];
+    header.centre[1]    = view.centre[1];
+    header.timescale    = view.timescale;
+
+    // lay out the sections one after another on 64 byte boundaries
+    const void *values[SECTION_COUNT] = { bodies.x.data(), bodies.y.data(), bodies.vx.data(), bodies.vy.data(),
+                                          bodies.m.data(), level.data(), trail_start.data(), trail_points.data() };
+    size_t      sizes[SECTION_COUNT]  = { n*sizeof(double), n*sizeof(double), n*sizeof(double), n*sizeof(double),
+                                          n*sizeof(double), n*sizeof(int32_t), (n+1)*sizeof(uint64_t),
+                                          trail_points.size()*sizeof(double) };
+
+    uint64_t offset = sizeof(Snapshot_Header);
+
+    for(int s = 0; s < SECTION_COUNT; s++) {
+
+        header.offsets[s] = align(offset);
+        offset            = header.offsets[s] + sizes[s];
+    }
+
+    header.file_bytes = offset;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if(!out) { return false; }
+
+    out.write((const char *) &header, sizeof(header));
+    for(int s = 0; s < SECTION_COUNT; s++) { write_section(out, header.offsets[s], values[s], sizes[s]); }
+
+    return (bool) out;
+}
+
+Snapshot_File::~Snapshot_File() {
+
+    close();
+}
+
+void Snapshot_File::close() {
+
+    if(data) { munmap((void *) data, bytes); }
+
+    data  = nullptr;
+    bytes = 0;
+}
+
+bool Snapshot_File::open(const std::string &path) {
+
+    close();
+    error.clear();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) { error = "couldn't open " + path; return false; }
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(Snapshot_Header)) {
+
+        ::close(fd);
+        error = path + " is too short to be a snapshot";
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(mapped == MAP_FAILED) { error = "couldn't map " + path; return false; }
+
+    data  = (const char *) mapped;
+    bytes = info.st_size;
+
+    // check the header before trusting any of its offsets
+    const Snapshot_Header &h = header();
+    uint64_t n = h.bodies;
+
+    if(std::memcmp(h.magic, snapshot_magic, sizeof(h.magic)) != 0) { error = path + " isn't a snapshot"; }
+    else if(h.version != snapshot_version)                          { error = path + " is snapshot version " + std::to_string(h.version)
+                                                                              + ", expected " + std::to_string(snapshot_version); }
+    else if(h.header_bytes != sizeof(Snapshot_Header) || h.file_bytes != bytes
+            || n > bytes || h.trail_points > bytes)                 { error = path + " is truncated or corrupt"; }
+
+    if(!error.empty()) { close(); return false; }
+
+    uint64_t sizes[SECTION_COUNT] = { n*sizeof(double), n*sizeof(double), n*sizeof(double), n*sizeof(double),
+                                      n*sizeof(double), n*sizeof(int32_t), (n+1)*sizeof(uint64_t),
+                                      h.trail_points*2*sizeof(double) };
+
+    for(int s = 0; s < SECTION_COUNT; s++) {
+
+        if(h.offsets[s] % 64 != 0 || h.offsets[s] > bytes || sizes[s] > bytes - h.offsets[s]) {
+
+            error = path + " is truncated or corrupt";
+            close();
+            return false;
+        }
+    }
+
+    // the trails are indexed by trail_start, so it has to be in order and in range
+    const uint64_t *start = trail_start();
+    for(uint64_t i = 0; i < n; i++) {
+
+        if(start[i] > start[i+1]) { error = path + " has corrupt trails"; close(); return false; }
+    }
+
+    if(start[0] != 0 || start[n] != h.trail_points) { error = path + " has corrupt trails"; close(); return false; }
+
+    // the settings go straight into the simulation, so reject any it can't step with
+    bool settings = h.traillength >= 0 && h.traillength <= max_snapshot_trail
+                    && h.force_method >= DIRECT_SUM && h.force_method <= CELL_LIST
+                    && h.max_level >= 0 && h.max_level <= max_timestep_level && h.dt > 0
+                    && h.mesh_size > 0 && (h.mesh_size & (h.mesh_size - 1)) == 0;
+
+    const int32_t *levels = level();
+    for(uint64_t i = 0; settings && i < n; i++) { settings = levels[i] >= 0 && levels[i] <= h.max_level; }
+
+    if(!settings) { error = path + " is truncated or corrupt"; close(); return false; }
+
+    // hint that the whole file is about to be read front to back
+    madvise((void *) data, bytes, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void Snapshot_File::restore(Simulation &sim, Snapshot_View &view) const {
+
+    const Snapshot_Header &h = header();
+    size_t n = h.bodies;
+
+    sim.traillength  = h.traillength;
+    sim.force_method = (Force_Method) h.force_method;
+    sim.max_level    = h.max_level;
+    sim.dt           = h.dt;
+    sim.eta          = h.eta;
+    sim.theta        = h.theta;
+    sim.mesh_size    = h.mesh_size;
+    sim.cutoff       = h.cutoff;
+    sim.softening    = h.softening;
+    sim.skin         = h.skin;
+    sim.single       = h.single != 0;
+    sim.merging      = h.merging != 0;
+    sim.steps        = h.steps;
+    sim.merges       = h.merges;
+    sim.accumulator  = 0;
+
+    // copy each section straight into the matching array - the forces are found again on the next step
+    sim.clear();
+
+    Body_Store &bodies = sim.bodies;
+    bodies.x.assign(x(), x() + n);
+    bodies.y.assign(y(), y() + n);
+    bodies.vx.assign(vx(), vx() + n);
+    bodies.vy.assign(vy(), vy() + n);
+    bodies.m.assign(m(), m() + n);
+    bodies.level.assign(level(), level() + n);
+    bodies.ax.assign(n, 0);
+    bodies.ay.assign(n, 0);
+
+    bodies.trails.set_capacity(h.traillength);
+    bodies.trails.reserve(n);
+    bodies.trail.resize(n);
+    bodies.handle.resize(n);
+
+    const uint64_t *start  = trail_start();
+    const double   *points = trail_points();
+
+    for(size_t i = 0; i < n; i++) {
+
+        bodies.trail[i]  = bodies.trails.acquire();
+        bodies.handle[i] = bodies.new_handle(i);
+
+        // oldest point first, so the newest ends up at the front of the ring
+        for(uint64_t p = start[i+1]; p > start[i]; p--) {
+
+            bodies.trails.push(bodies.trail[i], points[2*(p-1)], points[2*(p-1)+1]);
+        }
+    }
+
+    view.zoom      = h.zoom;
+    view.centre[0] = h.centre[0];
+    view.centre[1] = h.centre[1];
+    view.timescale = h.timescale;
+}
@@ -0,0 +1,116 @@
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+
+#include "simulation.h"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+// a snapshot file is a fixed header followed by one section per array, each starting on a 64 byte
+// boundary so it can be used in place from a memory mapping - everything is little-endian:
+//
+//   x, y, vx, vy, m    double per body
+//   level              int32 per body
+//   trail_start        uint64 per body + 1 - trail of body i is trail_points[trail_start[i] .. trail_start[i+1]]
+//   trail_points       x, y double pair per point, newest point of each trail first
+
+const char     snapshot_magic[8] = {'G', 'R', 'A', 'V', 'S', 'N', 'A', 'P'};
+const uint32_t snapshot_version  = 2;
+
+enum Snapshot_Section {
+
+    SECTION_X,
+    SECTION_Y,
+    SECTION_VX,
+    SECTION_VY,
+    SECTION_M,
+    SECTION_LEVEL,
+    SECTION_TRAIL_START,
+    SECTION_TRAIL_POINTS,
+    SECTION_COUNT
+};
+
+struct Snapshot_Header {
+
+    char     magic[8];                 // snapshot_magic
+    uint32_t version;                  // snapshot_version when written
+    uint32_t header_bytes;             // sizeof(Snapshot_Header) when written
+    uint64_t bodies;                   // number of bodies
+    uint64_t trail_points;             // total number of trail points
+    uint64_t offsets[SECTION_COUNT];   // byte offset of each section from the start of the file
+    uint64_t file_bytes;               // size of the whole file
+
+    // simulation settings
+    int32_t  traillength;              // length of trails behind bodies
+    int32_t  force_method;             // Force_Method used to calculate gravitational forces
+    int32_t  max_level;                // deepest timestep level
+    int32_t  mesh_size;                // nodes along each side of the particle mesh
+    double   dt;                       // simulated time advanced by each substep
+    double   eta;                      // accuracy of the timestep criteria
+    double   theta;                    // opening angle of the Barnes-Hut tree
+    double   cutoff;                   // pairs further apart are ignored, 0 for no cutoff
+    double   softening;                // softening length of the direct sum, 0 for none
+    double   skin;                     // margin of the Verlet lists of the cell list method
+    int32_t  single;                   // 1 if the direct sum is in float
+    int32_t  merging;                  // 1 if colliding bodies are joined
+    int64_t  steps;                    // number of substeps simulated
+    int64_t  merges;                   // number of bodies absorbed by collisions
+
+    // view of the ui that saved it
+    double   zoom;                     // level of zoom
+    double   centre[2];                // screen coordinates of the origin
+    double   timescale;                // scaling of simulation time
+};
+
+// state which belongs to whoever displays the simulation rather than to the simulation
+struct Snapshot_View {
+
+    double zoom      = 1.0;
+    double centre[2] = {350, 320};
+    double timescale = 1.0;
+};
+
+// writes the bodies, trails and settings of sim with view to path - false if it couldn't be written
+bool save_snapshot(const std::string &path, const Simulation &sim, const Snapshot_View &view);
+
+// a read-only memory mapping of a snapshot file - the arrays point straight into the mapping, so
+// opening one costs the same whatever the number of bodies and pages are only read when used
+class Snapshot_File {
+
+public:
+    Snapshot_File() = default;
+    ~Snapshot_File();
+
+    Snapshot_File(const Snapshot_File &) = delete;
+    Snapshot_File &operator=(const Snapshot_File &) = delete;
+
+    bool open(const std::string &path); // maps and checks the file - false with error set if it isn't usable
+    void close();                       // unmaps the file
+
+    const Snapshot_Header &header() const { return *(const Snapshot_Header *) data; }
+
+    size_t         bodies() const { return header().bodies; }
+    const double  *x()  const     { return section<double>(SECTION_X); }
+    const double  *y()  const     { return section<double>(SECTION_Y); }
+    const double  *vx() const     { return section<double>(SECTION_VX); }
+    const double  *vy() const     { return section<double>(SECTION_VY); }
+    const double  *m()  const     { return section<double>(SECTION_M); }
+    const int32_t *level() const  { return section<int32_t>(SECTION_LEVEL); }
+    const uint64_t *trail_start() const { return section<uint64_t>(SECTION_TRAIL_START); }
+    const double  *trail_points() const { return section<double>(SECTION_TRAIL_POINTS); }
+
+    // replaces the bodies, trails and settings of sim with the snapshot's and fills view
+    void restore(Simulation &sim, Snapshot_View &view) const;
+
+    std::string error;                  // why open last failed
+
+protected:
+    template<class T>
+    const T *section(Snapshot_Section s) const { return (const T *) (data + header().offsets[s]); }
+
+    const char *data  = nullptr;        // start of the mapping
+    size_t      bytes = 0;              // length of the mapping
+};
+
+#endif /* SNAPSHOT_FILE_H */
@@ -0,0 +1,167 @@
+#include "thread_pool.h"
+
+
+Thread_Pool::Thread_Pool(int threads) :
+    workers(0),
+    generation(0),
+    quit(false),
+    current(nullptr),
+    remaining(0) {
+
+    start(threads);
+}
+
+Thread_Pool::~Thread_Pool() {
+
+    stop();
+}
+
+void Thread_Pool::resize(int threads) {
+
+    stop();
+    start(threads);
+}
+
+void Thread_Pool::start(int threads) {
+
+    if(threads <= 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+
+    workers = threads - 1;
+    quit    = false;
+
+    queues.clear();
+    for(int w = 0; w < threads; w++) { queues.emplace_back(new Queue); }
+
+    // worker 0 is whichever thread calls run()
+    for(int w = 1; w < threads; w++) {
+
+        this->threads.emplace_back( [this, w](){loop(w);} );
+    }
+}
+
+void Thread_Pool::stop() {
+
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        quit = true;
+    }
+
+    wake.notify_all();
+
+    for(std::thread &thread : threads) { thread.join(); }
+    threads.clear();
+}
+
+void Thread_Pool::run(int tasks, const std::function<void(int, int)> &task) {
+
+    if(tasks <= 0) { return; }
+
+    // not worth waking the workers for a single task
+    if(tasks == 1 || workers == 0) {
+
+        for(int t = 0; t < tasks; t++) { task(t, 0); }
+        return;
+    }
+
+    // publish the task before dealing it out - a worker still leaving the previous run may take one
+    // of the new tasks straight away, and the queue lock orders this write before its read
+    current   = &task;
+    remaining = tasks;
+
+    // deal out contiguous ranges of tasks so neighbouring tiles start on the same thread
+    int threads = size();
+
+    for(int w = 0; w < threads; w++) {
+
+        std::lock_guard<std::mutex> guard(queues[w]->lock);
+
+        for(int t = tasks*w/threads; t < tasks*(w+1)/threads; t++) {
+
+            queues[w]->tasks.push_back(t);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        generation++;
+    }
+
+    wake.notify_all();
+
+    // the caller works too, then waits for any tasks still running on other threads
+    work(0);
+
+    std::unique_lock<std::mutex> guard(state_lock);
+    finished.wait(guard, [this](){return remaining == 0;});
+    current = nullptr;
+}
+
+bool Thread_Pool::take(int worker, int &task) {
+
+    int threads = size();
+
+    // own queue first, from the front
+    {
+        Queue &own = *queues[worker];
+        std::lock_guard<std::mutex> guard(own.lock);
+
+        if(!own.tasks.empty()) {
+
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // then steal from the back of the other queues, starting with the next worker along
+    for(int v = 1; v < threads; v++) {
+
+        Queue &victim = *queues[(worker + v) % threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+
+        if(!victim.tasks.empty()) {
+
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Thread_Pool::work(int worker) {
+
+    int task;
+
+    while(take(worker, task)) {
+
+        (*current)(task, worker);
+
+        // the last task to finish wakes the caller
+        if(--remaining == 0) {
+
+            std::lock_guard<std::mutex> guard(state_lock);
+            finished.notify_all();
+        }
+    }
+}
+
+void Thread_Pool::loop(int worker) {
+
+    unsigned seen = 0;
+
+    while(true) {
+
+        {
+            std::unique_lock<std::mutex> guard(state_lock);
+            wake.wait(guard, [&](){return quit || generation != seen;});
+
+            if(quit) { return; }
+
+            seen = generation;
+        }
+
+        work(worker);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+
+// persistent pool of worker threads - each run() deals tasks out to per-worker queues and
+// idle workers steal from the back of other workers' queues so uneven tiles still balance
+class Thread_Pool {
+
+public:
+    explicit Thread_Pool(int threads = 0); // 0 uses one thread per hardware thread
+    ~Thread_Pool();
+
+    int  size() const { return workers + 1; } // number of threads working on a run, including the caller
+    void resize(int threads);                 // stops the workers and starts the requested number
+
+    // calls task(t, worker) for every t in [0, tasks) and returns once they have all finished -
+    // worker is in [0, size()) and identifies the thread, which may differ between runs
+    void run(int tasks, const std::function<void(int, int)> &task);
+
+protected:
+    struct Queue {
+
+        std::mutex      lock;  // guards tasks
+        std::deque<int> tasks; // owner pops from the front, thieves from the back
+    };
+
+    void start(int threads);
+    void stop();
+    void work(int worker);   // runs tasks until none are left to take or steal
+    void loop(int worker);   // body of each persistent worker thread
+    bool take(int worker, int &task);
+
+    int                                 workers;     // number of threads besides the caller
+    std::vector<std::thread>            threads;     // persistent worker threads
+    std::vector<std::unique_ptr<Queue>> queues;      // one task queue per thread, caller's first
+
+    std::mutex                          state_lock;  // guards generation, quit and the wake condition
+    std::condition_variable             wake;        // signals the workers that a run has started
+    std::condition_variable             finished;    // signals the caller that every task is done
+    unsigned                            generation;  // incremented for each run
+    bool                                quit;        // tells the workers to exit
+
+    const std::function<void(int, int)> *current;    // task function of the current run
+    std::atomic<int>                    remaining;   // tasks of the current run not yet finished
+};
+
+#endif /* THREAD_POOL_H */
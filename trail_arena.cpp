@@ -0,0 +1,82 @@
+#include "trail_arena.h"
+#include <algorithm>
+
+
+void Trail_Arena::set_capacity(int capacity) {
+
+    if(capacity == ring_capacity) { return; }
+
+    // copy the newest points of every ring into a block laid out for the new capacity
+    std::vector<std::array<double, 2>> resized((size_t) rings.size() * capacity);
+
+    for(int r = 0; r < (int) rings.size(); r++) {
+
+        int kept = std::min(rings[r].count, capacity);
+
+        // oldest kept point first so the newest ends up in slot kept-1
+        for(int k = 0; k < kept; k++) {
+
+            resized[(size_t) r*capacity + k] = point(r, kept-1-k);
+        }
+
+        rings[r].head  = kept > 0 ? kept-1 : capacity-1;
+        rings[r].count = kept;
+    }
+
+    points.swap(resized);
+    ring_capacity = capacity;
+}
+
+int Trail_Arena::acquire() {
+
+    // double the number of rings when they run out, so growth is in bulk and rare
+    if(free_rings.empty()) {
+
+        int old_size = rings.size();
+        int new_size = std::max(16, 2*old_size);
+
+        rings.resize(new_size);
+        points.resize((size_t) new_size * ring_capacity);
+
+        for(int r = new_size-1; r >= old_size; r--) { free_rings.push_back(r); }
+    }
+
+    int ring = free_rings.back();
+    free_rings.pop_back();
+
+    rings[ring] = Ring{ ring_capacity-1, 0 };
+
+    return ring;
+}
+
+void Trail_Arena::reserve(int count) {
+
+    if((int) free_rings.size() >= count) { return; }
+
+    int old_size = rings.size();
+    int new_size = old_size + count - free_rings.size();
+
+    rings.resize(new_size);
+    points.resize((size_t) new_size * ring_capacity);
+
+    // the new rings go below the old free ones so they are taken in order after them
+    free_rings.insert(free_rings.begin(), new_size - old_size, 0);
+    for(int r = old_size; r < new_size; r++) { free_rings[new_size-1 - r] = r; }
+}
+
+void Trail_Arena::release(int ring) {
+
+    free_rings.push_back(ring);
+}
+
+void Trail_Arena::clear() {
+
+    free_rings.clear();
+
+    for(int r = rings.size()-1; r >= 0; r--) { free_rings.push_back(r); }
+}
+
+size_t Trail_Arena::bytes() const {
+
+    return points.capacity() * sizeof(points[0]) + rings.capacity() * sizeof(Ring) + free_rings.capacity() * sizeof(int);
+}
@@ -0,0 +1,60 @@
+#ifndef TRAIL_ARENA_H
+#define TRAIL_ARENA_H
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+
+// stores every trail in one preallocated block of fixed capacity ring buffers - pushing a point
+// overwrites the oldest one once a ring is full, so nothing is allocated in steady state
+class Trail_Arena {
+
+public:
+    int    capacity() const { return ring_capacity; }   // points each ring can hold
+    void   set_capacity(int points);                    // resizes every ring at once, keeping the newest points
+
+    int    acquire();                                   // takes an empty ring, growing the arena if none are free
+    void   reserve(int count);                          // grows the arena once so count rings can be taken without growing
+    void   release(int ring);                           // returns a ring to the free list
+    void   clear();                                     // releases every ring
+
+    // adds a point to the front of a ring, dropping the oldest point if it is full
+    void   push(int ring, double x, double y) {
+
+        if(ring_capacity == 0) { return; }
+
+        Ring &r = rings[ring];
+        r.head  = (r.head + 1 == ring_capacity) ? 0 : r.head + 1;
+        r.count = (r.count < ring_capacity) ? r.count + 1 : r.count;
+        points[(size_t) ring*ring_capacity + r.head] = {x, y};
+    }
+
+    // number of points in a ring
+    int    length(int ring) const { return rings[ring].count; }
+
+    // kth newest point of a ring, k = 0 being the point pushed last
+    const std::array<double, 2> &point(int ring, int k) const {
+
+        int slot = rings[ring].head - k;
+        if(slot < 0) { slot += ring_capacity; }
+        return points[(size_t) ring*ring_capacity + slot];
+    }
+
+    size_t bytes() const;                               // memory held by the arena
+    int    in_use() const { return rings.size() - free_rings.size(); }
+
+protected:
+    struct Ring {
+
+        int head;  // slot of the newest point
+        int count; // number of points stored
+    };
+
+    int                                ring_capacity = 0; // points per ring
+    std::vector<Ring>                  rings;             // state of each ring
+    std::vector<std::array<double, 2>> points;            // ring r occupies points[r*capacity .. (r+1)*capacity]
+    std::vector<int>                   free_rings;        // rings not attached to a body
+};
+
+#endif /* TRAIL_ARENA_H */
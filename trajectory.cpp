@@ -0,0 +1,650 @@
+#include "trajectory.h"
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+
+// signed differences are stored as unsigned varints with the sign in the lowest bit, so small
+// movements either way take one or two bytes
+static void put_varint(std::vector<char> &out, int64_t value) {
+
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+
+    while(zigzag >= 0x80) {
+
+        out.push_back((char) (zigzag | 0x80));
+        zigzag >>= 7;
+    }
+
+    out.push_back((char) zigzag);
+}
+
+static bool get_varint(const char *&in, const char *end, int64_t &value) {
+
+    uint64_t zigzag = 0;
+
+    for(int shift = 0; shift < 64; shift += 7) {
+
+        if(in == end) { return false; }
+
+        uint8_t byte = *in++;
+        zigzag |= (uint64_t) (byte & 0x7f) << shift;
+
+        if(!(byte & 0x80)) {
+
+            value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void put_bytes(std::vector<char> &out, const void *values, size_t bytes) {
+
+    out.insert(out.end(), (const char *) values, (const char *) values + bytes);
+}
+
+Trajectory_Recorder::~Trajectory_Recorder() {
+
+    close();
+}
+
+bool Trajectory_Recorder::open(const std::string &path, double quantum, int keyframe_interval, int max_queued) {
+
+    close();
+
+    file = std::fopen(path.c_str(), "wb");
+    if(!file) { return false; }
+
+    std::memcpy(header.magic, trajectory_magic, sizeof(header.magic));
+    header.version           = trajectory_version;
+    header.keyframe_interval = std::max(1, keyframe_interval);
+    header.quantum           = quantum;
+
+    std::fwrite(&header, sizeof(header), 1, file);
+
+    this->max_queued = std::max(1, max_queued);
+    frames           = 0;
+    bytes            = sizeof(header);
+    stopping         = false;
+    last_handle.clear();
+    last_m.clear();
+
+    writer = std::thread( [this](){write_loop();} );
+
+    return true;
+}
+
+void Trajectory_Recorder::close() {
+
+    if(!file) { return; }
+
+    // the writer drains the queue before it exits
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+
+    changed.notify_all();
+    writer.join();
+
+    std::fclose(file);
+    file = nullptr;
+}
+
+void Trajectory_Recorder::record(const Simulation &sim) {
+
+    if(!file) { return; }
+
+    const Body_Store &bodies = sim.bodies;
+    uint32_t n = bodies.size();
+
+    // take a buffer written out earlier, waiting for the writer if the queue is full
+    std::vector<char> buffer;
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this](){return (int) queued.size() < max_queued;});
+
+        if(!spare.empty()) {
+
+            buffer.swap(spare.back());
+            spare.pop_back();
+        }
+    }
+
+    buffer.clear();
+
+    bool key = frames == 0 || since_keyframe >= header.keyframe_interval;
+
+    Frame_Header frame = { key ? KEYFRAME : DELTA_FRAME, n, sim.steps, 0 };
+    put_bytes(buffer, &frame, sizeof(frame));
+
+    if(key) {
+
+        put_bytes(buffer, bodies.x.data(), n * sizeof(double));
+        put_bytes(buffer, bodies.y.data(), n * sizeof(double));
+        put_bytes(buffer, bodies.m.data(), n * sizeof(double));
+        put_order(bodies, buffer);
+
+        since_keyframe = 0;
+    }
+    else {
+
+        put_order(bodies, buffer);
+
+        // bodies added since, in full
+        for(uint32_t a = 0; a < n; a++) {
+
+            if(survivor[a] >= 0) { continue; }
+
+            double values[3] = {bodies.x[a], bodies.y[a], bodies.m[a]};
+            put_bytes(buffer, values, sizeof(values));
+        }
+
+        // bodies which have absorbed others
+        int changes = 0;
+        for(uint32_t k = 0; k < n; k++) { changes += survivor[k] >= 0 && bodies.m[k] != last_m[survivor[k]]; }
+
+        put_varint(buffer, changes);
+        for(int k = 0, last = 0; k < (int) n; k++) {
+
+            if(survivor[k] < 0 || bodies.m[k] == last_m[survivor[k]]) { continue; }
+
+            put_varint(buffer, k - last);
+            put_bytes(buffer, &bodies.m[k], sizeof(double));
+            last = k;
+        }
+
+        // then the positions of the bodies carried over
+        if(header.quantum > 0) {
+
+            for(uint32_t k = 0; k < n; k++) {
+
+                if(survivor[k] < 0) { continue; }
+
+                put_varint(buffer, std::llround(bodies.x[k] / header.quantum) - last_qx[survivor[k]]);
+                put_varint(buffer, std::llround(bodies.y[k] / header.quantum) - last_qy[survivor[k]]);
+            }
+        }
+        else {
+
+            for(uint32_t k = 0; k < n; k++) { if(survivor[k] >= 0) { put_bytes(buffer, &bodies.x[k], sizeof(double)); } }
+            for(uint32_t k = 0; k < n; k++) { if(survivor[k] >= 0) { put_bytes(buffer, &bodies.y[k], sizeof(double)); } }
+        }
+    }
+
+    // remember this frame for the next delta - the reader rounds positions the same way
+    last_handle.assign(bodies.handle.begin(), bodies.handle.end());
+    last_m.assign(bodies.m.begin(), bodies.m.end());
+
+    if(header.quantum > 0) {
+
+        last_qx.resize(n);
+        last_qy.resize(n);
+
+        for(uint32_t k = 0; k < n; k++) {
+
+            last_qx[k] = std::llround(bodies.x[k] / header.quantum);
+            last_qy[k] = std::llround(bodies.y[k] / header.quantum);
+        }
+    }
+
+    uint64_t payload = buffer.size() - sizeof(frame);
+    std::memcpy(buffer.data() + offsetof(Frame_Header, payload_bytes), &payload, sizeof(payload));
+
+    since_keyframe++;
+    frames++;
+    bytes += buffer.size();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queued.push_back(std::move(buffer));
+    }
+
+    changed.notify_all();
+}
+
+void Trajectory_Recorder::put_order(const Body_Store &bodies, std::vector<char> &buffer) {
+
+    uint32_t n = bodies.size();
+
+    // a body's handle identifies it in both frames, wherever removals have moved it to
+    uint32_t slots = bodies.slot_body.size();
+    for(const Body_Handle &h : last_handle) { slots = std::max(slots, h.slot + 1); }
+
+    previous.assign(slots, -1);
+    for(int j = 0; j < (int) last_handle.size(); j++) { previous[last_handle[j].slot] = j; }
+
+    survivor.resize(n);
+    carried.assign(last_handle.size(), -1);
+
+    for(uint32_t i = 0; i < n; i++) {
+
+        int j = previous[bodies.handle[i].slot];
+
+        survivor[i] = j >= 0 && last_handle[j] == bodies.handle[i] ? j : -1;
+        if(survivor[i] >= 0) { carried[j] = 0; }
+    }
+
+    // number the carried over bodies in their old order
+    removed.clear();
+    int kept = 0;
+
+    for(int j = 0; j < (int) last_handle.size(); j++) {
+
+        if(carried[j] < 0) { removed.push_back(j); }
+        else               { carried[j] = kept++; }
+    }
+
+    // the previous frame's bodies which are gone, as gaps between their indices
+    put_varint(buffer, removed.size());
+    for(int k = 0; k < (int) removed.size(); k++) { put_varint(buffer, removed[k] - (k ? removed[k-1] : 0)); }
+
+    // the order of the bodies, as runs of consecutive carried over bodies and of added ones
+    runs.clear();
+
+    for(uint32_t i = 0; i < n; i++) {
+
+        int  first = survivor[i] >= 0 ? carried[survivor[i]] : -1;
+        bool added = first < 0;
+
+        if(!runs.empty() && (added ? runs.back()[0] < 0 : runs.back()[0] > 0 && runs.back()[1] + runs.back()[0] == first)) {
+
+            runs.back()[0] += added ? -1 : 1;
+        }
+        else {
+
+            runs.push_back( {added ? -1 : 1, first} );
+        }
+    }
+
+    put_varint(buffer, runs.size());
+    for(int r = 0, expected = 0; r < (int) runs.size(); r++) {
+
+        put_varint(buffer, runs[r][0]);
+        if(runs[r][0] < 0) { continue; }
+
+        put_varint(buffer, runs[r][1] - expected);
+        expected = runs[r][1] + runs[r][0];
+    }
+}
+
+void Trajectory_Recorder::write_loop() {
+
+    std::unique_lock<std::mutex> guard(lock);
+
+    while(true) {
+
+        changed.wait(guard, [this](){return stopping || !queued.empty();});
+
+        if(queued.empty()) { return; }
+
+        // write without holding the lock so record() can keep encoding
+        std::vector<char> buffer = std::move(queued.front());
+        queued.pop_front();
+
+        guard.unlock();
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        guard.lock();
+
+        spare.push_back(std::move(buffer));
+        changed.notify_all();
+    }
+}
+
+Trajectory_Reader::~Trajectory_Reader() {
+
+    close();
+}
+
+void Trajectory_Reader::close() {
+
+    if(file) { std::fclose(file); }
+
+    file          = nullptr;
+    current_frame = -1;
+    index.clear();
+}
+
+bool Trajectory_Reader::open(const std::string &path) {
+
+    close();
+    error.clear();
+
+    file = std::fopen(path.c_str(), "rb");
+    if(!file) { error = "couldn't open " + path; return false; }
+
+    if(std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, trajectory_magic, sizeof(header.magic)) != 0) {
+
+        error = path + " isn't a trajectory";
+        close();
+        return false;
+    }
+
+    if(header.version < 1 || header.version > trajectory_version) {
+
+        error = path + " is trajectory version " + std::to_string(header.version) + ", expected " + std::to_string(trajectory_version);
+        close();
+        return false;
+    }
+
+    // index every frame by skipping from header to header - a frame cut short by the recording
+    // being stopped uncleanly is left out
+    std::fseek(file, 0, SEEK_END);
+    long size   = std::ftell(file);
+    long offset = sizeof(header);
+    long key    = -1;
+
+    while(offset + (long) sizeof(Frame_Header) <= size) {
+
+        Entry entry;
+        std::fseek(file, offset, SEEK_SET);
+        if(std::fread(&entry.header, sizeof(Frame_Header), 1, file) != 1) { break; }
+
+        entry.offset = offset + sizeof(Frame_Header);
+        if(entry.header.payload_bytes > (uint64_t) (size - entry.offset)) { break; }
+
+        // delta frames before the first keyframe have nothing to be decoded from
+        if(entry.header.kind == KEYFRAME) { key = index.size(); }
+        if(key < 0) { break; }
+
+        entry.keyframe = key;
+        index.push_back(entry);
+        offset = entry.offset + entry.header.payload_bytes;
+    }
+
+    return true;
+}
+
+bool Trajectory_Reader::read(long f, Trajectory_Frame &frame) {
+
+    if(f < 0 || f >= frames()) { error = "no frame " + std::to_string(f); return false; }
+
+    // the bodies can only be followed from the frame before if it was the last one read
+    bool follows = current_frame == f - 1 && (index[f].header.kind == DELTA_FRAME || header.version >= 3);
+
+    // continue from the last frame read if it is between the keyframe and f
+    long from = index[f].keyframe;
+    if(current_frame >= from && current_frame <= f) { from = current_frame + 1; }
+
+    for(long k = from; k <= f; k++) {
+
+        if(!decode(k)) { current_frame = -1; return false; }
+    }
+
+    frame.x.assign(current.x.begin(), current.x.end());
+    frame.y.assign(current.y.begin(), current.y.end());
+    frame.m.assign(current.m.begin(), current.m.end());
+    frame.step = current.step;
+
+    if(follows) { frame.source.assign(source.begin(), source.end()); }
+    else        { frame.source.clear(); }
+
+    return true;
+}
+
+// reads raw bytes of a value written with put_bytes
+template<class T>
+static bool get_value(const char *&in, const char *end, T &value) {
+
+    if(end - in < (long) sizeof(T)) { return false; }
+
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return true;
+}
+
+bool Trajectory_Reader::decode(long f) {
+
+    const Entry &entry = index[f];
+    uint32_t     n     = entry.header.bodies;
+
+    payload.resize(entry.header.payload_bytes);
+    std::fseek(file, entry.offset, SEEK_SET);
+
+    if(std::fread(payload.data(), 1, payload.size(), file) != payload.size()) {
+
+        error = "couldn't read frame " + std::to_string(f);
+        return false;
+    }
+
+    const char *in      = payload.data();
+    const char *end     = in + payload.size();
+    std::string corrupt = "frame " + std::to_string(f) + " is corrupt";
+
+    if(entry.header.kind == KEYFRAME) {
+
+        // the order follows the bodies from version 3 on
+        size_t bodies = 3 * n * sizeof(double);
+        if(header.version < 3 ? payload.size() != bodies : payload.size() < bodies) { error = corrupt; return false; }
+
+        // which bodies of the frame before the keyframe's were is only known if current holds that frame
+        size_t previous = current.m.size();
+        bool   linked   = header.version >= 3 && current_frame == f - 1;
+
+        current.x.assign((const double *) in,         (const double *) in + n);
+        current.y.assign((const double *) in + n,     (const double *) in + 2*n);
+        current.m.assign((const double *) in + 2*n,   (const double *) in + 3*n);
+        in += bodies;
+
+        if(linked && !get_order(in, end, n, previous)) { error = corrupt; return false; }
+
+        // quantised deltas continue from the keyframe rounded the same way the recorder rounded it
+        if(header.quantum > 0) {
+
+            qx.resize(n);
+            qy.resize(n);
+
+            for(uint32_t k = 0; k < n; k++) {
+
+                qx[k] = std::llround(current.x[k] / header.quantum);
+                qy[k] = std::llround(current.y[k] / header.quantum);
+            }
+        }
+    }
+    else {
+
+        if(!get_order(in, end, n, current.m.size())) { error = corrupt; return false; }
+
+        next.x.resize(n);
+        next.y.resize(n);
+        next.m.resize(n);
+        next_qx.resize(n);
+        next_qy.resize(n);
+
+        int64_t added = 0;
+
+        for(uint32_t k = 0; k < n; k++) {
+
+            int j = source[k];
+            if(j < 0) { added++; continue; }
+
+            next.x[k] = current.x[j];
+            next.y[k] = current.y[j];
+            next.m[k] = current.m[j];
+            if(header.quantum > 0) { next_qx[k] = qx[j]; next_qy[k] = qy[j]; }
+        }
+
+        // the added bodies only take their place after the positions of the others are read
+        const char *additions = in;
+        if(end - in < added * 3 * (long) sizeof(double)) { error = corrupt; return false; }
+        in += added * 3 * sizeof(double);
+
+        // masses of the bodies which absorbed others
+        int64_t changes, gap, k = 0;
+        if(!get_varint(in, end, changes)) { error = corrupt; return false; }
+
+        for(int64_t c = 0; c < changes; c++) {
+
+            if(!get_varint(in, end, gap) || (k += gap) < 0 || k >= n || source[k] < 0 || !get_value(in, end, next.m[k])) { error = corrupt; return false; }
+        }
+
+        if(header.quantum > 0) {
+
+            for(uint32_t k = 0; k < n; k++) {
+
+                if(source[k] < 0) { continue; }
+
+                int64_t dx, dy;
+                if(!get_varint(in, end, dx) || !get_varint(in, end, dy)) { error = corrupt; return false; }
+
+                next_qx[k] += dx;
+                next_qy[k] += dy;
+                next.x[k] = next_qx[k] * header.quantum;
+                next.y[k] = next_qy[k] * header.quantum;
+            }
+        }
+        else {
+
+            int64_t carried_over = n - added;
+            if(end - in < (long) (2 * carried_over * sizeof(double))) { error = corrupt; return false; }
+
+            for(uint32_t k = 0; k < n; k++) { if(source[k] >= 0) { get_value(in, end, next.x[k]); } }
+            for(uint32_t k = 0; k < n; k++) { if(source[k] >= 0) { get_value(in, end, next.y[k]); } }
+        }
+
+        for(uint32_t a = 0; a < n; a++) {
+
+            if(source[a] >= 0) { continue; }
+
+            double values[3];
+            get_value(additions, end, values);
+
+            next.x[a] = values[0];
+            next.y[a] = values[1];
+            next.m[a] = values[2];
+
+            if(header.quantum > 0) {
+
+                next_qx[a] = std::llround(values[0] / header.quantum);
+                next_qy[a] = std::llround(values[1] / header.quantum);
+            }
+        }
+
+        current.x.swap(next.x);
+        current.y.swap(next.y);
+        current.m.swap(next.m);
+        if(header.quantum > 0) { qx.swap(next_qx); qy.swap(next_qy); }
+    }
+
+    current.step  = entry.header.step;
+    current_frame = f;
+
+    return true;
+}
+
+bool Trajectory_Reader::get_order(const char *&in, const char *end, uint32_t n, size_t previous) {
+
+    // number the bodies which are carried over, in their order
+    int64_t count, gap, at = 0;
+    if(!get_varint(in, end, count) || count < 0 || count > (int64_t) previous) { return false; }
+
+    removed.assign(previous, false);
+
+    for(int64_t k = 0; k < count; k++) {
+
+        if(!get_varint(in, end, gap) || (at += gap) < 0 || at >= (int64_t) removed.size()) { return false; }
+        removed[at] = true;
+    }
+
+    carried.clear();
+    for(size_t k = 0; k < removed.size(); k++) { if(!removed[k]) { carried.push_back(k); } }
+
+    int64_t kept = carried.size();
+
+    // then where each body comes from
+    source.clear();
+
+    if(header.version == 1) {
+
+        int64_t added;
+        if(!get_varint(in, end, added) || added < 0 || kept + added != n) { return false; }
+
+        source.assign(carried.begin(), carried.end());
+        source.resize(n, -1);
+    }
+    else {
+
+        int64_t runs, length, first, expected = 0;
+        if(!get_varint(in, end, runs) || runs < 0 || runs > n) { return false; }
+
+        for(int64_t r = 0; r < runs; r++) {
+
+            if(!get_varint(in, end, length) || length == 0 || std::abs(length) > (int64_t) (n - source.size())) { return false; }
+
+            if(length < 0) { source.resize(source.size() - length, -1); continue; }
+
+            if(!get_varint(in, end, first) || (first += expected) < 0 || first + length > kept) { return false; }
+
+            source.insert(source.end(), carried.begin() + first, carried.begin() + first + length);
+            expected = first + length;
+        }
+
+        if(source.size() != n) { return false; }
+    }
+
+    return true;
+}
+
+void show_frame(const Trajectory_Frame &frame, Simulation &sim, bool restart) {
+
+    int         n      = frame.m.size();
+    Body_Store &bodies = sim.bodies;
+
+    // sim holds the frame before if each body is carried over from a different one of its bodies
+    bool follows = !restart && (int) frame.source.size() == n;
+
+    std::vector<char>        kept(bodies.size(), false);
+    std::vector<Body_Handle> handles(n);
+
+    for(int k = 0; follows && k < n; k++) {
+
+        int j = frame.source[k];
+        if(j < 0) { continue; }
+
+        follows = j < bodies.size() && !kept[j];
+        if(follows) { kept[j] = true; handles[k] = bodies.handle[j]; }
+    }
+
+    if(follows) {
+
+        // removing the bodies which are gone releases their trails, and the added ones take new trails
+        // at the end - then each body is put where the frame has it, keeping its trail
+        std::vector<int> gone, order(n);
+        for(int j = 0; j < bodies.size(); j++) { if(!kept[j]) { gone.push_back(j); } }
+
+        bodies.remove(gone);
+
+        for(int k = 0; k < n; k++) {
+
+            if(frame.source[k] >= 0) { order[k] = bodies.find(handles[k]); continue; }
+
+            bodies.push_back( Body{ {frame.x[k], frame.y[k]}, {0, 0}, frame.m[k] } );
+            order[k] = bodies.size() - 1;
+        }
+
+        bodies.permute(order);
+
+        bodies.x.assign(frame.x.begin(), frame.x.end());
+        bodies.y.assign(frame.y.begin(), frame.y.end());
+        bodies.m.assign(frame.m.begin(), frame.m.end());
+    }
+
+    // otherwise new bodies start new trails, and the same number of bodies are moved with their trails carrying on
+    else if(restart || bodies.size() != n) {
+
+        sim.clear();
+        for(int i = 0; i < n; i++) { sim.add( Body{ {frame.x[i], frame.y[i]}, {0, 0}, frame.m[i] } ); }
+    }
+    else {
+
+        sim.bodies.x.assign(frame.x.begin(), frame.x.end());
+        sim.bodies.y.assign(frame.y.begin(), frame.y.end());
+        sim.bodies.m.assign(frame.m.begin(), frame.m.end());
+    }
+
+    sim.steps = frame.step;
+    sim.store_trails();
+}
@@ -0,0 +1,172 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "simulation.h"
+#include <vector>
+#include <array>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+
+// a trajectory file is a header followed by one frame per recorded step - a keyframe holds the
+// position and mass of every body, a delta frame only what changed since the frame before it.
+// Keyframes are written every keyframe_interval frames, so any frame can be rebuilt by decoding
+// forward from the keyframe before it. Counts and indices are zigzag varints:
+//
+//   keyframe           x, y, m double per body
+//                      order of the bodies, as in a delta frame - only read when playing on from
+//                      the frame before, so that trails can follow the bodies across a keyframe
+//   delta frame        order of the bodies:
+//                        count and index gaps of the previous frame's bodies which are gone
+//                        count of runs the bodies now fall into, then for each its length - positive
+//                        for a run of carried over bodies, followed by the change in the index of its
+//                        first body among them from the end of the run of them before, and negative
+//                        for a run of added bodies
+//                      x, y, m double for each added body
+//                      count of carried over bodies whose mass changed, then index gap and mass double for each
+//                      x, y double per carried over body, or with a quantum, the change in
+//                      round(x/quantum) and round(y/quantum) as varints
+//
+// Removing a body moves the last body into its place, so the carried over bodies are mostly one
+// run in their old order with a few moved forward. Version 1 files had no runs - the bodies kept
+// their order and the added ones came last, stored as their count - and keyframes before version 3
+// had no order
+
+const char     trajectory_magic[8] = {'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J'};
+const uint32_t trajectory_version  = 3;
+
+struct Trajectory_Header {
+
+    char     magic[8];           // trajectory_magic
+    uint32_t version;            // trajectory_version when written
+    uint32_t keyframe_interval;  // frames between keyframes
+    double   quantum;            // spacing positions are rounded to in delta frames - 0 stores them exactly
+};
+
+enum Frame_Kind : uint32_t { KEYFRAME, DELTA_FRAME };
+
+struct Frame_Header {
+
+    uint32_t kind;               // Frame_Kind
+    uint32_t bodies;             // number of bodies
+    int64_t  step;               // value of sim.steps when recorded
+    uint64_t payload_bytes;      // bytes of body data following this header
+};
+
+// one decoded frame
+struct Trajectory_Frame {
+
+    std::vector<double> x;       // x coordinate of each body
+    std::vector<double> y;       // y coordinate of each body
+    std::vector<double> m;       // mass of each body
+    std::vector<int>    source;  // body of the frame read before each body was, -1 if added - empty unless
+                                 // this frame was read straight after the one before it
+    long                step = 0;
+};
+
+// streams frames to a file - record() encodes on the calling thread and hands the bytes to a
+// writer thread through a queue of at most max_queued frames, so the simulation only waits on
+// the disk once that many frames are outstanding
+class Trajectory_Recorder {
+
+public:
+    ~Trajectory_Recorder();
+
+    // starts a new file at path - quantum 0 records positions exactly
+    bool open(const std::string &path, double quantum = 0, int keyframe_interval = 120, int max_queued = 16);
+    void close();                // writes every queued frame and closes the file
+
+    bool is_open() const { return file != nullptr; }
+
+    void record(const Simulation &sim);
+
+    long frames = 0;             // number of frames recorded
+    long bytes  = 0;             // number of bytes recorded
+
+protected:
+    void write_loop();           // body of the writer thread
+
+    // finds which body of the previous frame each body of bodies was and writes the order of the bodies
+    void put_order(const Body_Store &bodies, std::vector<char> &buffer);
+
+    std::FILE                    *file = nullptr;
+    Trajectory_Header            header;
+    std::vector<Body_Handle>     last_handle;     // handle of each body in the previous frame, which identifies it
+    std::vector<double>          last_m;          // masses of the previous frame
+    std::vector<int64_t>         last_qx;         // quantised positions of the previous frame
+    std::vector<int64_t>         last_qy;
+    std::vector<int>             previous;        // body of the previous frame holding each slot, -1 for none
+    std::vector<int>             survivor;        // body of the previous frame each body was, -1 if added
+    std::vector<int>             carried;         // index among the carried over bodies of each body of the previous frame
+    std::vector<int>             removed;         // bodies of the previous frame which are gone
+    std::vector<std::array<int, 2>> runs;         // length and first carried over index of each run
+    long                         since_keyframe = 0;
+
+    std::thread                  writer;          // writes queued frames to the file
+    std::mutex                   lock;            // guards queued, spare and stopping
+    std::condition_variable      changed;         // signals frames queued, written or stopping
+    std::deque<std::vector<char>> queued;         // encoded frames waiting to be written
+    std::vector<std::vector<char>> spare;         // written buffers kept for reuse
+    int                          max_queued = 16;
+    bool                         stopping   = false;
+};
+
+// reads frames back from a trajectory file - frames are found by scanning their headers when the
+// file is opened, and reading a frame decodes forward from the nearest keyframe before it, or from
+// the last frame read if that is closer, so playing forward decodes each frame once
+class Trajectory_Reader {
+
+public:
+    ~Trajectory_Reader();
+
+    bool open(const std::string &path);  // false with error set if it isn't a trajectory
+    void close();
+
+    long frames() const { return index.size(); }
+
+    // fills frame with frame number f, which must be in [0, frames())
+    bool read(long f, Trajectory_Frame &frame);
+
+    std::string error;                   // why open or read last failed
+
+protected:
+    struct Entry {
+
+        Frame_Header header;             // header of the frame
+        long         offset;             // offset of its payload in the file
+        long         keyframe;           // index of the keyframe it is decoded from
+    };
+
+    bool decode(long f);                 // decodes frame f into current from current, which holds f-1 or a keyframe
+
+    // reads the order of the n bodies of a frame following one of previous bodies into source
+    bool get_order(const char *&in, const char *end, uint32_t n, size_t previous);
+
+    std::FILE           *file = nullptr;
+    Trajectory_Header    header;
+    std::vector<Entry>   index;          // every frame in the file
+    std::vector<char>    payload;        // bytes of the frame being decoded
+    Trajectory_Frame     current;        // last decoded frame
+    std::vector<int64_t> qx;             // quantised positions of current
+    std::vector<int64_t> qy;
+    std::vector<char>    removed;        // bodies of current which are gone in the frame being decoded
+    std::vector<int>     carried;        // bodies of current which are carried over, in order
+    std::vector<int>     source;         // body of current each body of the frame being decoded was, -1 if added
+    Trajectory_Frame     next;           // frame being decoded
+    std::vector<int64_t> next_qx;
+    std::vector<int64_t> next_qy;
+    long                 current_frame = -1;
+};
+
+// puts the bodies of sim where they were in frame and stores their trails, without any physics -
+// restart starts every trail again, as after seeking. If sim holds the frame before and frame says
+// where its bodies came from, only the bodies which are gone lose their trails and only the added
+// ones start new trails
+void show_frame(const Trajectory_Frame &frame, Simulation &sim, bool restart = false);
+
+#endif /* TRAJECTORY_H */
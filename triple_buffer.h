@@ -0,0 +1,40 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+
+// lock-free hand over of values from one producer thread to one consumer thread - the producer fills
+// back() and publishes it, the consumer reads front() which always points to the newest complete value,
+// and neither ever waits for the other or sees a value that is still being written
+template<class T>
+class Triple_Buffer {
+
+public:
+    // slot the producer is filling, never seen by the consumer until published
+    T &back() { return slots[back_index]; }
+
+    // hands the filled back slot to the consumer and takes over an unused slot to fill next
+    void publish() { back_index = ready.exchange(back_index | fresh_bit) & index_mask; }
+
+    // true if a published value hasn't been picked up by the consumer yet
+    bool pending() const { return ready.load() & fresh_bit; }
+
+    // newest published value - stays valid and unchanged until the next call to front()
+    const T &front() {
+
+        if(ready.load() & fresh_bit) { front_index = ready.exchange(front_index) & index_mask; }
+        return slots[front_index];
+    }
+
+protected:
+    static const int index_mask = 3;
+    static const int fresh_bit  = 4;
+
+    T                slots[3];
+    int              back_index  = 0; // owned by the producer
+    int              front_index = 1; // owned by the consumer
+    std::atomic<int> ready{2};        // slot waiting to be picked up, with fresh_bit set if it's new
+};
+
+#endif /* TRIPLE_BUFFER_H */